@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Synthetic frame source for the imx307 driver on an emulated I2C bus.
+#
+# Watches a file holding the sensor's 64 KiB register space, as exported
+# by an emulated I2C device, and while the sensor is streaming produces
+# the frames it would output: size from the output size registers, RAW8
+# or CSI-2 packed RAW10 from the frame format registers, Bayer order from
+# the flips, and the test pattern and its colours. Frames are paced at
+# PIXEL_RATE / (line length * frame length), the rate the driver's timing
+# assumes, and the frame counter register is advanced for each one, as
+# the sensor does.
+#
+# With the test pattern disabled, a fixed grey ramp stands in for a scene.
+#
+# Frames go to stdout, or to a V4L2 output device such as v4l2loopback,
+# whose format is set to match.
+#
+# Usage:
+#   imx307-emulator.py --output /dev/video10 REGS
+#   imx307-emulator.py --frames 100 REGS > frames.raw
+
+import argparse
+import fcntl
+import os
+import struct
+import sys
+import time
+
+PIXEL_RATE = 182400000
+
+REG_FRAME_COUNT = 0x0018
+REG_MODE_SELECT = 0x0100
+REG_VTS = 0x0160
+REG_LINE_LENGTH = 0x0162
+REG_X_OUTPUT_SIZE = 0x016c
+REG_Y_OUTPUT_SIZE = 0x016e
+REG_ORIENTATION = 0x0172
+REG_CSI_DATA_FORMAT = 0x018d
+REG_TEST_PATTERN = 0x0600
+REG_TESTP_RED = 0x0602
+REG_TESTP_GREENR = 0x0604
+REG_TESTP_BLUE = 0x0606
+REG_TESTP_GREENB = 0x0608
+
+# Registers below this address are read back on every frame
+REGS_WINDOW = 0x0700
+
+# Values of the test pattern register, see imx307_test_pattern_val[]
+TEST_PATTERN_DISABLE = 0
+TEST_PATTERN_SOLID_COLOR = 1
+TEST_PATTERN_COLOR_BARS = 2
+TEST_PATTERN_GREY_COLOR = 3
+TEST_PATTERN_PN9 = 4
+
+PATTERN_NAMES = {
+    TEST_PATTERN_DISABLE: 'disabled',
+    TEST_PATTERN_SOLID_COLOR: 'solid color',
+    TEST_PATTERN_COLOR_BARS: 'color bars',
+    TEST_PATTERN_GREY_COLOR: 'grey color bars',
+    TEST_PATTERN_PN9: 'PN9',
+}
+
+# Bayer order by orientation register value, see imx307_get_format_code()
+BAYER_ORDERS = ['RGGB', 'GRBG', 'GBRG', 'BGGR']
+
+FOURCCS = {
+    (8, 'RGGB'): 'RGGB', (8, 'GRBG'): 'GRBG',
+    (8, 'GBRG'): 'GBRG', (8, 'BGGR'): 'BA81',
+    (10, 'RGGB'): 'pRAA', (10, 'GRBG'): 'pgAA',
+    (10, 'GBRG'): 'pGAA', (10, 'BGGR'): 'pBAA',
+}
+
+# 100% colour bars, as (R, G, B)
+COLOR_BARS = [
+    (1023, 1023, 1023), (1023, 1023, 0), (0, 1023, 1023), (0, 1023, 0),
+    (1023, 0, 1023), (1023, 0, 0), (0, 0, 1023), (0, 0, 0),
+]
+
+# Number of distinct lines the grey color bars fade through
+GREY_FADE_STEPS = 64
+
+V4L2_BUF_TYPE_VIDEO_OUTPUT = 2
+V4L2_FIELD_NONE = 1
+V4L2_COLORSPACE_RAW = 11
+
+# struct v4l2_format: type, then a union aligned like a pointer
+_FORMAT_PAD = struct.calcsize('P') - 4
+V4L2_FORMAT = struct.Struct('<I%dx12I%dx' % (_FORMAT_PAD, 200 - 48))
+VIDIOC_S_FMT = (3 << 30) | (V4L2_FORMAT.size << 16) | (ord('V') << 8) | 5
+
+
+class SensorState:
+    def __init__(self, regs):
+        def reg16(addr):
+            return (regs[addr] << 8) | regs[addr + 1]
+
+        self.streaming = bool(regs[REG_MODE_SELECT] & 1)
+        self.width = reg16(REG_X_OUTPUT_SIZE)
+        self.height = reg16(REG_Y_OUTPUT_SIZE)
+        self.bit_depth = 8 if regs[REG_CSI_DATA_FORMAT] == 8 else 10
+        self.bayer = BAYER_ORDERS[regs[REG_ORIENTATION] & 3]
+        self.vts = reg16(REG_VTS)
+        self.line_length = reg16(REG_LINE_LENGTH)
+        self.pattern = reg16(REG_TEST_PATTERN)
+        self.colors = tuple(reg16(a) & 0x3ff for a in
+                            (REG_TESTP_RED, REG_TESTP_GREENR,
+                             REG_TESTP_BLUE, REG_TESTP_GREENB))
+
+    def image_key(self):
+        return (self.width, self.height, self.bit_depth, self.bayer,
+                self.pattern, self.colors)
+
+    def frame_period(self):
+        if not self.vts or not self.line_length:
+            return None
+        return self.line_length * self.vts / PIXEL_RATE
+
+    @property
+    def bytesperline(self):
+        return self.width * self.bit_depth // 8
+
+    def describe(self):
+        period = self.frame_period()
+        return '%dx%d raw%d %s, %s fps, pattern %s' % (
+            self.width, self.height, self.bit_depth, self.bayer,
+            '%.2f' % (1 / period) if period else '-',
+            PATTERN_NAMES.get(self.pattern, '0x%x' % self.pattern))
+
+
+def bayer_line(pixels, bayer, odd):
+    """Turn a line of (R, Gr, B, Gb) values into its Bayer samples."""
+    order = bayer[2:] if odd else bayer[:2]
+    index = []
+    for c in order:
+        if c == 'R':
+            index.append(0)
+        elif c == 'B':
+            index.append(2)
+        else:
+            # Green next to red is Gr, next to blue Gb
+            index.append(1 if 'R' in order else 3)
+    return [p[index[x & 1]] for x, p in enumerate(pixels)]
+
+
+def pack_line(samples, bit_depth):
+    if bit_depth == 8:
+        return bytes(s >> 2 for s in samples)
+
+    # CSI-2 RAW10: four MSB bytes, then the four pairs of LSBs
+    out = bytearray()
+    for i in range(0, len(samples) - 3, 4):
+        a, b, c, d = samples[i:i + 4]
+        out += bytes((a >> 2, b >> 2, c >> 2, d >> 2,
+                      (a & 3) | (b & 3) << 2 | (c & 3) << 4 | (d & 3) << 6))
+    return bytes(out)
+
+
+def rgb_pixels(width, colors_at):
+    return [colors_at(x) for x in range(width)]
+
+
+def bars(width, bar_colors):
+    n = len(bar_colors)
+    return rgb_pixels(width, lambda x: bar_colors[x * n // width])
+
+
+def rgb_to_channels(rgb):
+    r, g, b = rgb
+    return (r, g, b, g)
+
+
+def pn9_sequence():
+    state = 0x1ff
+    seq = []
+    for _ in range(511):
+        bit = ((state >> 8) ^ (state >> 4)) & 1
+        state = ((state << 1) | bit) & 0x1ff
+        seq.append(state << 1)
+    return seq
+
+
+def make_frame(state):
+    """Return one frame, built from a few distinct packed lines."""
+    width, height = state.width, state.height
+    lines = {}
+
+    def line(key, y, pixels):
+        odd = y & 1
+        if (key, odd) not in lines:
+            lines[key, odd] = pack_line(
+                bayer_line(pixels(), state.bayer, odd), state.bit_depth)
+        return lines[key, odd]
+
+    if state.pattern == TEST_PATTERN_SOLID_COLOR:
+        return b''.join(line(0, y, lambda: [state.colors] * width)
+                        for y in range(height))
+
+    if state.pattern == TEST_PATTERN_COLOR_BARS:
+        return b''.join(line(0, y, lambda: bars(width, [
+            rgb_to_channels(c) for c in COLOR_BARS]))
+            for y in range(height))
+
+    if state.pattern == TEST_PATTERN_GREY_COLOR:
+        # Colour bars fading to mid grey towards the bottom of the frame
+        def faded(step):
+            f = step / (GREY_FADE_STEPS - 1)
+            return bars(width, [rgb_to_channels(
+                tuple(round(v + (512 - v) * f) for v in c))
+                for c in COLOR_BARS])
+
+        return b''.join(line(step, y, lambda: faded(step))
+                        for y in range(height)
+                        for step in [y * GREY_FADE_STEPS // height])
+
+    if state.pattern == TEST_PATTERN_PN9:
+        # The sequence runs on across lines, so only 511 lines differ
+        seq = pn9_sequence()
+        out = []
+        for y in range(height):
+            start = (y * width) % len(seq)
+            if start not in lines:
+                lines[start] = pack_line(
+                    [seq[(start + x) % len(seq)] for x in range(width)],
+                    state.bit_depth)
+            out.append(lines[start])
+        return b''.join(out)
+
+    # No test pattern: a horizontal grey ramp
+    return b''.join(line(0, y, lambda: rgb_pixels(
+        width, lambda x: (64 + x * 896 // width,) * 4))
+        for y in range(height))
+
+
+def write_all(fd, data):
+    view = memoryview(data)
+    while view:
+        view = view[os.write(fd, view):]
+
+
+def set_output_format(fd, state):
+    fourcc = FOURCCS[state.bit_depth, state.bayer]
+    buf = bytearray(V4L2_FORMAT.pack(
+        V4L2_BUF_TYPE_VIDEO_OUTPUT, state.width, state.height,
+        struct.unpack('<I', fourcc.encode())[0], V4L2_FIELD_NONE,
+        state.bytesperline, state.bytesperline * state.height,
+        V4L2_COLORSPACE_RAW, 0, 0, 0, 0, 0))
+    fcntl.ioctl(fd, VIDIOC_S_FMT, buf)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Emulate imx307 frames from its programmed registers')
+    parser.add_argument('regs', help='register file of the emulated sensor')
+    parser.add_argument('--output', default='-',
+                        help='V4L2 output device, or - for stdout (default)')
+    parser.add_argument('--frames', type=int, default=0,
+                        help='stop after this many frames, 0 to run forever')
+    parser.add_argument('--poll-ms', type=int, default=20,
+                        help='register poll interval while not streaming')
+    args = parser.parse_args()
+
+    regs = os.open(args.regs, os.O_RDWR)
+    if args.output == '-':
+        out, v4l2 = sys.stdout.fileno(), False
+    else:
+        out, v4l2 = os.open(args.output, os.O_RDWR), True
+
+    frame = None
+    image_key = None
+    out_fmt = None
+    description = None
+    deadline = None
+    count = 0
+
+    while not args.frames or count < args.frames:
+        state = SensorState(os.pread(regs, REGS_WINDOW, 0))
+        period = state.frame_period()
+
+        if state.describe() != description:
+            description = state.describe()
+            sys.stderr.write('%s: %s\n' % (
+                'streaming' if state.streaming else 'standby', description))
+
+        if not state.streaming or not period or not state.width:
+            deadline = None
+            time.sleep(args.poll_ms / 1000)
+            continue
+
+        if state.image_key() != image_key:
+            image_key = state.image_key()
+            frame = make_frame(state)
+
+        if v4l2 and (state.width, state.height, state.bit_depth,
+                     state.bayer) != out_fmt:
+            out_fmt = (state.width, state.height, state.bit_depth,
+                       state.bayer)
+            set_output_format(out, state)
+
+        now = time.monotonic()
+        if deadline is None:
+            deadline = now
+        if deadline > now:
+            time.sleep(deadline - now)
+        deadline += period
+
+        write_all(out, frame)
+        count += 1
+        os.pwrite(regs, bytes([count & 0xff]), REG_FRAME_COUNT)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Register sequence compiler for the imx307 driver.
+#
+# Reads a human-readable description of the mode and frame format register
+# sequences and emits them as packed burst tables for imx307.c, or as a
+# firmware blob for the driver's "firmware-name" property.
+#
+# Description syntax, one statement per line, '#' starts a comment:
+#
+#   mode <width>x<height>        start a mode table
+#   crop <left> <top> <w> <h>    analog crop of the current mode
+#   vts <lines>                  default frame length of the current mode
+#   framefmt raw8|raw10          start a frame format table
+#   ordered                      following writes are emitted as written
+#   sorted                       following writes may be deduplicated and
+#                                sorted by address (the default)
+#   <address> <value>            register write
+#
+# Within a sorted block only the last write to each address is kept, and
+# writes are sorted so that consecutive addresses merge into one burst.
+# Ordered blocks are for sequences where repeated writes or their order
+# matter, such as the manufacturer register access code.
+#
+# Usage:
+#   imx307-regcomp.py imx307-modes.txt > tables.c
+#   imx307-regcomp.py --report imx307-modes.txt
+#   imx307-regcomp.py --firmware imx307-modes.bin imx307-modes.txt
+
+import argparse
+import struct
+import sys
+import zlib
+
+BURST_MAX_LEN = 32
+
+FW_MAGIC = 0x37303349
+FW_VERSION = 1
+FW_TABLE_MODE = 1
+FW_TABLE_FRAMEFMT = 2
+
+
+class Table:
+    def __init__(self, kind, name, lineno):
+        self.kind = kind
+        self.name = name
+        self.lineno = lineno
+        self.width = self.height = 0
+        self.crop = None
+        self.vts = None
+        self.bit_depth = 0
+        # List of (ordered, [(address, value), ...]) blocks
+        self.blocks = []
+
+    @property
+    def symbol(self):
+        if self.kind == 'mode':
+            return 'mode_%dx%d_bursts' % (self.width, self.height)
+        return '%s_framefmt_bursts' % self.name
+
+    def writes(self):
+        return [w for _, block in self.blocks for w in block]
+
+
+def parse_int(tok, path, lineno):
+    try:
+        return int(tok, 0)
+    except ValueError:
+        sys.exit('%s:%d: bad number "%s"' % (path, lineno, tok))
+
+
+def parse(path):
+    tables = []
+    table = None
+    ordered = False
+
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            toks = line.split('#', 1)[0].split()
+            if not toks:
+                continue
+
+            if toks[0] == 'mode':
+                table = Table('mode', toks[1], lineno)
+                try:
+                    table.width, table.height = map(int, toks[1].split('x'))
+                except ValueError:
+                    sys.exit('%s:%d: bad mode size' % (path, lineno))
+                tables.append(table)
+                ordered = False
+                continue
+
+            if toks[0] == 'framefmt':
+                if toks[1] not in ('raw8', 'raw10'):
+                    sys.exit('%s:%d: unknown frame format' % (path, lineno))
+                table = Table('framefmt', toks[1], lineno)
+                table.bit_depth = int(toks[1][3:])
+                tables.append(table)
+                ordered = False
+                continue
+
+            if table is None:
+                sys.exit('%s:%d: statement outside a table' % (path, lineno))
+
+            if toks[0] in ('ordered', 'sorted'):
+                ordered = toks[0] == 'ordered'
+                table.blocks.append((ordered, []))
+            elif toks[0] == 'crop' and len(toks) == 5:
+                table.crop = [parse_int(t, path, lineno) for t in toks[1:]]
+            elif toks[0] == 'vts' and len(toks) == 2:
+                table.vts = parse_int(toks[1], path, lineno)
+            elif len(toks) == 2:
+                addr = parse_int(toks[0], path, lineno)
+                val = parse_int(toks[1], path, lineno)
+                if addr > 0xffff or val > 0xff:
+                    sys.exit('%s:%d: write out of range' % (path, lineno))
+                if not table.blocks or table.blocks[-1][0] != ordered:
+                    table.blocks.append((ordered, []))
+                table.blocks[-1][1].append((addr, val))
+            else:
+                sys.exit('%s:%d: syntax error' % (path, lineno))
+
+    for table in tables:
+        if table.kind == 'mode' and (table.crop is None or table.vts is None):
+            sys.exit('%s:%d: mode needs crop and vts' % (path, table.lineno))
+        if not table.writes():
+            sys.exit('%s:%d: empty table' % (path, table.lineno))
+
+    return tables
+
+
+def optimize(table):
+    """Return the writes of a table in the order they should be sent."""
+    out = []
+    for ordered, block in table.blocks:
+        if ordered:
+            out.extend(block)
+        else:
+            last = {}
+            for addr, val in block:
+                last[addr] = val
+            out.extend(sorted(last.items()))
+    return out
+
+
+def bursts(writes):
+    """Group writes into (address, [values]) bursts."""
+    segs = []
+    for addr, val in writes:
+        if segs:
+            start, vals = segs[-1]
+            if start + len(vals) == addr and len(vals) < BURST_MAX_LEN:
+                vals.append(val)
+                continue
+        segs.append((addr, [val]))
+    return segs
+
+
+def final_state(writes):
+    state = {}
+    for addr, val in writes:
+        state[addr] = val
+    return state
+
+
+def emit_c(tables, out):
+    for table in tables:
+        segs = bursts(optimize(table))
+        out.write('static const u8 %s[] = {\n' % table.symbol)
+        for addr, vals in segs:
+            out.write('\timx307_BURST(0x%04x, %d),' % (addr, len(vals)))
+            if len(vals) == 1:
+                out.write(' 0x%02x,\n' % vals[0])
+                continue
+            out.write('\n')
+            for i in range(0, len(vals), 8):
+                out.write('\t\t%s\n' % ' '.join('0x%02x,' % v
+                                               for v in vals[i:i + 8]))
+        out.write('};\n\n')
+
+
+def emit_firmware(tables, path):
+    payload = b''
+    for table in tables:
+        writes = optimize(table)
+        if table.kind == 'mode':
+            payload += struct.pack('<BBHHHHHHHHH', FW_TABLE_MODE, 0,
+                                   len(writes), table.width, table.height,
+                                   *table.crop, table.vts, 0)
+        else:
+            payload += struct.pack('<BBHHHHHHHHH', FW_TABLE_FRAMEFMT,
+                                   table.bit_depth, len(writes),
+                                   0, 0, 0, 0, 0, 0, 0, 0)
+        for addr, val in writes:
+            payload += struct.pack('<HBB', addr, val, 0)
+
+    header = struct.pack('<IHHII', FW_MAGIC, FW_VERSION, len(tables),
+                         len(payload), zlib.crc32(payload) & 0xffffffff)
+    with open(path, 'wb') as f:
+        f.write(header + payload)
+
+
+def report(tables, out):
+    out.write('%-24s %8s %8s %8s %8s\n' %
+              ('table', 'writes', 'xfers', 'rodata', 'packed'))
+    for table in tables:
+        writes = table.writes()
+        segs = bursts(optimize(table))
+        # struct imx307_reg is padded to 4 bytes, a burst has 3 header bytes
+        packed = sum(3 + len(vals) for _, vals in segs)
+        out.write('%-24s %8d %8d %8d %8d\n' %
+                  (table.symbol, len(writes), len(segs), len(writes) * 4,
+                   packed))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compile imx307 register sequences')
+    parser.add_argument('description')
+    parser.add_argument('--firmware', metavar='FILE',
+                        help='write a firmware blob instead of C tables')
+    parser.add_argument('--report', action='store_true',
+                        help='print transaction counts instead of C tables')
+    args = parser.parse_args()
+
+    tables = parse(args.description)
+
+    # The optimized sequence must leave every register as the original did
+    for table in tables:
+        optimized = [(a, v) for a, vals in bursts(optimize(table))
+                     for a, v in zip(range(a, a + len(vals)), vals)]
+        if final_state(optimized) != final_state(table.writes()):
+            sys.exit('%s: optimization changed register state' %
+                     table.symbol)
+
+    if args.report:
+        report(tables, sys.stdout)
+    elif args.firmware:
+        emit_firmware(tables, args.firmware)
+    else:
+        emit_c(tables, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
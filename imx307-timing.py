@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0
+#
+# Ioctl latency and lock contention measurements for the imx307 driver.
+#
+# Drives the subdev node with storms of VIDIOC_SUBDEV_S_FMT and
+# VIDIOC_S_CTRL calls and reports the latency distribution of each. With
+# --threads, every thread uses its own file handle, so that the numbers
+# include waiting on the driver's mutex.
+#
+# Usage:
+#   imx307-timing.py /dev/v4l-subdev0
+#   imx307-timing.py --iterations 5000 --threads 4 /dev/v4l-subdev0
+
+import argparse
+import fcntl
+import os
+import random
+import statistics
+import struct
+import sys
+import threading
+import time
+
+# struct v4l2_subdev_format: which, pad, v4l2_mbus_framefmt, reserved[8]
+SUBDEV_FORMAT = struct.Struct('<II IIIII HHHH 10H 8I')
+# struct v4l2_control: id, value
+CONTROL = struct.Struct('<Ii')
+# struct v4l2_queryctrl: id, type, name, min, max, step, default, flags,
+# reserved[2]
+QUERYCTRL = struct.Struct('<II32siiiiI2I')
+
+
+def _iowr(nr, size):
+    return (3 << 30) | (size << 16) | (ord('V') << 8) | nr
+
+
+VIDIOC_SUBDEV_S_FMT = _iowr(5, SUBDEV_FORMAT.size)
+VIDIOC_G_CTRL = _iowr(27, CONTROL.size)
+VIDIOC_S_CTRL = _iowr(28, CONTROL.size)
+VIDIOC_QUERYCTRL = _iowr(36, QUERYCTRL.size)
+
+V4L2_SUBDEV_FORMAT_ACTIVE = 1
+V4L2_FIELD_NONE = 1
+V4L2_CTRL_FLAG_DISABLED = 0x0001
+V4L2_CTRL_FLAG_READ_ONLY = 0x0004
+
+MEDIA_BUS_FMT_SRGGB8_1X8 = 0x3014
+MEDIA_BUS_FMT_SRGGB10_1X10 = 0x300f
+
+# Sizes of the modes in supported_modes[]
+MODES = [(3280, 2464), (1920, 1080), (1640, 1232), (640, 480)]
+
+CONTROLS = {
+    'exposure': 0x00980911,
+    'hflip': 0x00980914,
+    'vflip': 0x00980915,
+    'vblank': 0x009e0901,
+    'analogue_gain': 0x009e0903,
+    'test_pattern': 0x009f0903,
+    'digital_gain': 0x009f0905,
+}
+
+
+def query_ctrl(fd, cid):
+    buf = bytearray(QUERYCTRL.pack(cid, 0, b'', 0, 0, 0, 0, 0, 0, 0))
+    fcntl.ioctl(fd, VIDIOC_QUERYCTRL, buf)
+    _, _, _, lo, hi, step, _, flags, _, _ = QUERYCTRL.unpack(buf)
+    if flags & (V4L2_CTRL_FLAG_DISABLED | V4L2_CTRL_FLAG_READ_ONLY):
+        return None
+    return lo, hi, max(step, 1)
+
+
+def set_fmt(fd, width, height, code):
+    buf = bytearray(SUBDEV_FORMAT.pack(V4L2_SUBDEV_FORMAT_ACTIVE, 0,
+                                       width, height, code, V4L2_FIELD_NONE,
+                                       0, 0, 0, 0, 0, *[0] * 10, *[0] * 8))
+    fcntl.ioctl(fd, VIDIOC_SUBDEV_S_FMT, buf)
+
+
+def set_ctrl(fd, cid, value):
+    fcntl.ioctl(fd, VIDIOC_S_CTRL, bytearray(CONTROL.pack(cid, value)))
+
+
+def fmt_storm(fd, iterations, rng):
+    samples = []
+    for _ in range(iterations):
+        width, height = rng.choice(MODES)
+        code = rng.choice((MEDIA_BUS_FMT_SRGGB8_1X8,
+                           MEDIA_BUS_FMT_SRGGB10_1X10))
+        start = time.perf_counter_ns()
+        set_fmt(fd, width, height, code)
+        samples.append(time.perf_counter_ns() - start)
+    return samples
+
+
+def ctrl_storm(fd, iterations, rng, ranges):
+    samples = []
+    cids = sorted(ranges)
+    for _ in range(iterations):
+        cid = rng.choice(cids)
+        lo, hi, step = ranges[cid]
+        value = lo + rng.randrange((hi - lo) // step + 1) * step
+        start = time.perf_counter_ns()
+        try:
+            set_ctrl(fd, cid, value)
+        except OSError:
+            # The range of some controls follows others, e.g. exposure
+            # follows vblank, so a stale value may be refused
+            continue
+        samples.append(time.perf_counter_ns() - start)
+    return samples
+
+
+def run_threads(args, storm, *storm_args):
+    results = [None] * args.threads
+    errors = []
+
+    def worker(index):
+        fd = os.open(args.device, os.O_RDWR)
+        try:
+            rng = random.Random(args.seed + index)
+            results[index] = storm(fd, args.iterations, rng, *storm_args)
+        except OSError as e:
+            errors.append(e)
+        finally:
+            os.close(fd)
+
+    threads = [threading.Thread(target=worker, args=(i,))
+               for i in range(args.threads)]
+    start = time.perf_counter_ns()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter_ns() - start
+
+    if errors:
+        sys.exit('%s: %s' % (args.device, errors[0]))
+
+    return [s for r in results for s in r], elapsed
+
+
+def report(name, samples, elapsed, out):
+    if not samples:
+        out.write('%-16s no successful calls\n' % name)
+        return
+    samples.sort()
+    us = [s / 1000 for s in samples]
+    p99 = us[min(len(us) - 1, len(us) * 99 // 100)]
+    out.write('%-16s %8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.0f\n' %
+              (name, len(us), us[0], statistics.median(us), p99, us[-1],
+               statistics.mean(us), len(us) / (elapsed / 1e9)))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Measure imx307 subdev ioctl latencies')
+    parser.add_argument('device', help='subdev node, e.g. /dev/v4l-subdev0')
+    parser.add_argument('--iterations', type=int, default=1000,
+                        help='calls per storm and thread (default 1000)')
+    parser.add_argument('--threads', type=int, default=1,
+                        help='concurrent file handles (default 1)')
+    parser.add_argument('--seed', type=int, default=0,
+                        help='random seed, for repeatable runs')
+    args = parser.parse_args()
+
+    fd = os.open(args.device, os.O_RDWR)
+    ranges = {}
+    for cid in CONTROLS.values():
+        try:
+            r = query_ctrl(fd, cid)
+        except OSError:
+            continue
+        if r is not None:
+            ranges[cid] = r
+    os.close(fd)
+
+    if not ranges:
+        sys.exit('%s: no writable controls found' % args.device)
+
+    out = sys.stdout
+    out.write('%d thread(s), %d calls each, latencies in us\n' %
+              (args.threads, args.iterations))
+    out.write('%-16s %8s %10s %10s %10s %10s %10s %10s\n' %
+              ('ioctl', 'calls', 'min', 'median', 'p99', 'max', 'mean',
+               'calls/s'))
+
+    samples, elapsed = run_threads(args, fmt_storm)
+    report('SUBDEV_S_FMT', samples, elapsed, out)
+
+    samples, elapsed = run_threads(args, ctrl_storm, ranges)
+    report('S_CTRL', samples, elapsed, out)
+
+
+if __name__ == '__main__':
+    main()
@@ -9,12 +9,22 @@
  */
 
 #include <linux/clk.h>
+#include <linux/crc32.h>
 #include <linux/delay.h>
+#include <linux/firmware.h>
 #include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/pm_runtime.h>
 #include <linux/regulator/consumer.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-event.h>
@@ -29,6 +39,12 @@
 #define imx307_MODE_STANDBY		    0x00
 #define imx307_MODE_STREAMING		0x01
 
+/* Grouped parameter hold, defers register updates to the same frame */
+#define imx307_REG_GROUP_HOLD		0x0104
+
+/* Frame counter, incremented by the sensor on every output frame */
+#define imx307_REG_FRAME_COUNT		0x0018
+
 /* Chip ID */
 #define imx307_REG_CHIP_ID		0x0000
 #define imx307_CHIP_ID			0x0219
@@ -67,6 +83,9 @@
 #define imx307_EXPOSURE_DEFAULT		0x640
 #define imx307_EXPOSURE_MAX		    65535
 
+/* V4L2_CID_EXPOSURE_ABSOLUTE is in 100us units */
+#define imx307_EXPOSURE_ABS_UNIT_NS	100000
+
 /* Analog gain control */
 #define imx307_REG_ANALOG_GAIN		0x0157
 #define imx307_ANA_GAIN_MIN		    0
@@ -81,6 +100,15 @@
 #define imx307_DGTL_GAIN_DEFAULT	0x0100
 #define imx307_DGTL_GAIN_STEP		1
 
+/*
+ * Combined gain control, in 0.1 dB. Gain is taken from the analogue stage
+ * up to imx307_ANA_GAIN_DB_MAX and from the digital stage beyond that.
+ */
+#define imx307_ANA_GAIN_DB_MAX		205
+#define imx307_DGTL_GAIN_DB_MAX		240
+#define imx307_GAIN_DB_MAX		(imx307_ANA_GAIN_DB_MAX + \
+					 imx307_DGTL_GAIN_DB_MAX)
+
 #define imx307_REG_ORIENTATION		0x0172
 
 /* Test Pattern Control */
@@ -116,20 +144,54 @@
 #define imx307_EMBEDDED_LINE_WIDTH 16384
 #define imx307_NUM_EMBEDDED_LINES  1
 
+/* Custom controls */
+#define imx307_CID_BASE			(V4L2_CID_CAMERA_CLASS_BASE + 0x1000)
+#define imx307_CID_EXPOSURE_US		(imx307_CID_BASE + 0)
+#define imx307_CID_GAIN_DB		(imx307_CID_BASE + 1)
+#define imx307_CID_AUTO_FRAME_LENGTH	(imx307_CID_BASE + 2)
+#define imx307_CID_BRACKET		(imx307_CID_BASE + 3)
+#define imx307_CID_TRIGGER_MODE		(imx307_CID_BASE + 4)
+#define imx307_CID_TRIGGER_FRAMES	(imx307_CID_BASE + 5)
+#define imx307_CID_TRIGGER		(imx307_CID_BASE + 6)
+#define imx307_CID_TRIGGER_LATENCY_US	(imx307_CID_BASE + 7)
+
+/* Number of V4L2_EVENT_FRAME_SYNC events kept per subscriber */
+#define imx307_FRAME_SYNC_EVENTS	4
+
+/* Sent after the watchdog has restarted a stalled sensor */
+#define imx307_EVENT_WATCHDOG_RECOVERY	(V4L2_EVENT_PRIVATE_START + 1)
+
+/*
+ * Sent when a flip changes the bayer order while streaming. The payload is
+ * a struct imx307_event_bayer_order giving the new media bus code and the
+ * sequence number of the first frame using it, as counted by the
+ * V4L2_EVENT_FRAME_SYNC events. Without XVS the sequence is always 0.
+ */
+#define imx307_EVENT_BAYER_ORDER	(V4L2_EVENT_PRIVATE_START + 2)
+
+struct imx307_event_bayer_order {
+	__u32 code;
+	__u32 frame_sequence;
+};
+
 enum pad_types {
 	IMAGE_PAD,
 	METADATA_PAD,
 	NUM_PADS
 };
 
-struct imx307_reg {
-	u16 address;
-	u8 val;
-};
+/*
+ * Register writes packed into burst segments. Each segment is laid out as
+ *   <n> <address high> <address low> <value 0> ... <value n-1>
+ * so everything after the length byte can be used directly as the buffer
+ * of a single I2C write message.
+ */
+#define imx307_BURST_MAX_LEN		32
+#define imx307_BURST(addr, n)		(n), ((addr) >> 8), ((addr) & 0xff)
 
-struct imx307_reg_list {
-	unsigned int num_of_regs;
-	const struct imx307_reg *regs;
+struct imx307_burst_list {
+	unsigned int len;
+	const u8 *data;
 };
 
 /* Mode : resolution and related config&values */
@@ -146,254 +208,290 @@ struct imx307_mode {
 	unsigned int vts_def;
 
 	/* Default register values */
-	struct imx307_reg_list reg_list;
+	struct imx307_burst_list bursts;
+};
+
+/*
+ * Optional firmware mode tables, named by the "firmware-name" property.
+ * All fields are little endian. The header is followed by num_tables
+ * tables, each a struct imx307_fw_table followed by num_regs registers.
+ * The CRC is the IEEE CRC-32 of everything after the header.
+ */
+#define imx307_FW_MAGIC			0x37303349 /* "I307" */
+#define imx307_FW_VERSION		1
+#define imx307_FW_MAX_MODES		8
+
+enum imx307_fw_table_type {
+	imx307_FW_TABLE_MODE = 1,
+	imx307_FW_TABLE_FRAMEFMT = 2,
+};
+
+struct imx307_fw_header {
+	__le32 magic;
+	__le16 version;
+	__le16 num_tables;
+	__le32 size;
+	__le32 crc;
+} __packed;
+
+struct imx307_fw_reg {
+	__le16 address;
+	u8 val;
+	u8 reserved;
+} __packed;
+
+struct imx307_fw_table {
+	u8 type;
+	/* Frame format tables only: 8 or 10 */
+	u8 bit_depth;
+	__le16 num_regs;
+	/* Mode tables only */
+	__le16 width;
+	__le16 height;
+	__le16 crop_left;
+	__le16 crop_top;
+	__le16 crop_width;
+	__le16 crop_height;
+	__le16 vts_def;
+	__le16 reserved;
+	struct imx307_fw_reg regs[];
+} __packed;
+
+/*
+ * Register writes collected while applying a batch of controls, sent as a
+ * single multi-message I2C transfer. Writes to consecutive addresses share
+ * one message.
+ */
+#define imx307_QUEUE_MAX_MSGS		16
+#define imx307_QUEUE_BUF_SIZE		128
+
+struct imx307_reg_queue {
+	unsigned int num_msgs;
+	unsigned int len;
+	struct i2c_msg msgs[imx307_QUEUE_MAX_MSGS];
+	u8 buf[imx307_QUEUE_BUF_SIZE];
+};
+
+/*
+ * Last value written to each control register since power on, used to
+ * skip writes that would not change anything.
+ */
+#define imx307_NUM_CACHED_REGS		16
+
+struct imx307_cached_reg {
+	u16 address;
+	u8 len;
+	bool valid;
+	u32 val;
+};
+
+/*
+ * Exposure bracketing sequence. Each entry of the control is an
+ * { exposure in lines, gain in 0.1 dB, frame length in lines } tuple, and
+ * the sequence ends at the first entry with a zero exposure. A zero frame
+ * length keeps the frame length in use when the sequence was set.
+ */
+#define imx307_BRACKET_MAX_FRAMES	16
+
+enum imx307_bracket_field {
+	imx307_BRACKET_EXPOSURE,
+	imx307_BRACKET_GAIN_DB,
+	imx307_BRACKET_VTS,
+	imx307_BRACKET_NUM_FIELDS
+};
+
+/* Register values of one frame of the bracketing sequence */
+struct imx307_bracket_frame {
+	u16 exposure;
+	u16 vts;
+	u16 again;
+	u16 dgain;
+};
+
+enum imx307_framefmt {
+	imx307_FRAMEFMT_RAW8,
+	imx307_FRAMEFMT_RAW10,
+	imx307_NUM_FRAMEFMTS
 };
 
 /*
  * Register sets lifted off the i2C interface from the Raspberry Pi firmware
- * driver.
+ * driver, generated from imx307-modes.txt by imx307-regcomp.py.
  * 3280x2464 = mode 2, 1920x1080 = mode 1, 1640x1232 = mode 4, 640x480 = mode 7.
  */
-static const struct imx307_reg mode_3280x2464_regs[] = {
-	{0x0100, 0x00},
-	{0x30eb, 0x0c},
-	{0x30eb, 0x05},
-	{0x300a, 0xff},
-	{0x300b, 0xff},
-	{0x30eb, 0x05},
-	{0x30eb, 0x09},
-	{0x0114, 0x01},
-	{0x0128, 0x00},
-	{0x012a, 0x18},
-	{0x012b, 0x00},
-	{0x0164, 0x00},
-	{0x0165, 0x00},
-	{0x0166, 0x0c},
-	{0x0167, 0xcf},
-	{0x0168, 0x00},
-	{0x0169, 0x00},
-	{0x016a, 0x09},
-	{0x016b, 0x9f},
-	{0x016c, 0x0c},
-	{0x016d, 0xd0},
-	{0x016e, 0x09},
-	{0x016f, 0xa0},
-	{0x0170, 0x01},
-	{0x0171, 0x01},
-	{0x0174, 0x00},
-	{0x0175, 0x00},
-	{0x0301, 0x05},
-	{0x0303, 0x01},
-	{0x0304, 0x03},
-	{0x0305, 0x03},
-	{0x0306, 0x00},
-	{0x0307, 0x39},
-	{0x030b, 0x01},
-	{0x030c, 0x00},
-	{0x030d, 0x72},
-	{0x0624, 0x0c},
-	{0x0625, 0xd0},
-	{0x0626, 0x09},
-	{0x0627, 0xa0},
-	{0x455e, 0x00},
-	{0x471e, 0x4b},
-	{0x4767, 0x0f},
-	{0x4750, 0x14},
-	{0x4540, 0x00},
-	{0x47b4, 0x14},
-	{0x4713, 0x30},
-	{0x478b, 0x10},
-	{0x478f, 0x10},
-	{0x4793, 0x10},
-	{0x4797, 0x0e},
-	{0x479b, 0x0e},
-	{0x0162, 0x0d},
-	{0x0163, 0x78},
+static const u8 mode_3280x2464_bursts[] = {
+	imx307_BURST(0x0100, 1), 0x00,
+	imx307_BURST(0x30eb, 1), 0x0c,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x300a, 2),
+		0xff, 0xff,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x09,
+	imx307_BURST(0x0114, 1), 0x01,
+	imx307_BURST(0x0128, 1), 0x00,
+	imx307_BURST(0x012a, 2),
+		0x18, 0x00,
+	imx307_BURST(0x0162, 16),
+		0x0d, 0x78, 0x00, 0x00, 0x0c, 0xcf, 0x00, 0x00,
+		0x09, 0x9f, 0x0c, 0xd0, 0x09, 0xa0, 0x01, 0x01,
+	imx307_BURST(0x0174, 2),
+		0x00, 0x00,
+	imx307_BURST(0x0301, 1), 0x05,
+	imx307_BURST(0x0303, 5),
+		0x01, 0x03, 0x03, 0x00, 0x39,
+	imx307_BURST(0x030b, 3),
+		0x01, 0x00, 0x72,
+	imx307_BURST(0x0624, 4),
+		0x0c, 0xd0, 0x09, 0xa0,
+	imx307_BURST(0x4540, 1), 0x00,
+	imx307_BURST(0x455e, 1), 0x00,
+	imx307_BURST(0x4713, 1), 0x30,
+	imx307_BURST(0x471e, 1), 0x4b,
+	imx307_BURST(0x4750, 1), 0x14,
+	imx307_BURST(0x4767, 1), 0x0f,
+	imx307_BURST(0x478b, 1), 0x10,
+	imx307_BURST(0x478f, 1), 0x10,
+	imx307_BURST(0x4793, 1), 0x10,
+	imx307_BURST(0x4797, 1), 0x0e,
+	imx307_BURST(0x479b, 1), 0x0e,
+	imx307_BURST(0x47b4, 1), 0x14,
+};
+
+static const u8 mode_1920x1080_bursts[] = {
+	imx307_BURST(0x0100, 1), 0x00,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x0c,
+	imx307_BURST(0x300a, 2),
+		0xff, 0xff,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x09,
+	imx307_BURST(0x0114, 1), 0x01,
+	imx307_BURST(0x0128, 1), 0x00,
+	imx307_BURST(0x012a, 2),
+		0x18, 0x00,
+	imx307_BURST(0x0162, 16),
+		0x0d, 0x78, 0x02, 0xa8, 0x0a, 0x27, 0x02, 0xb4,
+		0x06, 0xeb, 0x07, 0x80, 0x04, 0x38, 0x01, 0x01,
+	imx307_BURST(0x0174, 2),
+		0x00, 0x00,
+	imx307_BURST(0x0301, 1), 0x05,
+	imx307_BURST(0x0303, 5),
+		0x01, 0x03, 0x03, 0x00, 0x39,
+	imx307_BURST(0x030b, 3),
+		0x01, 0x00, 0x72,
+	imx307_BURST(0x0624, 4),
+		0x07, 0x80, 0x04, 0x38,
+	imx307_BURST(0x4540, 1), 0x00,
+	imx307_BURST(0x455e, 1), 0x00,
+	imx307_BURST(0x4713, 1), 0x30,
+	imx307_BURST(0x471e, 1), 0x4b,
+	imx307_BURST(0x4750, 1), 0x14,
+	imx307_BURST(0x4767, 1), 0x0f,
+	imx307_BURST(0x478b, 1), 0x10,
+	imx307_BURST(0x478f, 1), 0x10,
+	imx307_BURST(0x4793, 1), 0x10,
+	imx307_BURST(0x4797, 1), 0x0e,
+	imx307_BURST(0x479b, 1), 0x0e,
+	imx307_BURST(0x47b4, 1), 0x14,
 };
 
-static const struct imx307_reg mode_1920_1080_regs[] = {
-	{0x0100, 0x00},
-	{0x30eb, 0x05},
-	{0x30eb, 0x0c},
-	{0x300a, 0xff},
-	{0x300b, 0xff},
-	{0x30eb, 0x05},
-	{0x30eb, 0x09},
-	{0x0114, 0x01},
-	{0x0128, 0x00},
-	{0x012a, 0x18},
-	{0x012b, 0x00},
-	{0x0162, 0x0d},
-	{0x0163, 0x78},
-	{0x0164, 0x02},
-	{0x0165, 0xa8},
-	{0x0166, 0x0a},
-	{0x0167, 0x27},
-	{0x0168, 0x02},
-	{0x0169, 0xb4},
-	{0x016a, 0x06},
-	{0x016b, 0xeb},
-	{0x016c, 0x07},
-	{0x016d, 0x80},
-	{0x016e, 0x04},
-	{0x016f, 0x38},
-	{0x0170, 0x01},
-	{0x0171, 0x01},
-	{0x0174, 0x00},
-	{0x0175, 0x00},
-	{0x0301, 0x05},
-	{0x0303, 0x01},
-	{0x0304, 0x03},
-	{0x0305, 0x03},
-	{0x0306, 0x00},
-	{0x0307, 0x39},
-	{0x030b, 0x01},
-	{0x030c, 0x00},
-	{0x030d, 0x72},
-	{0x0624, 0x07},
-	{0x0625, 0x80},
-	{0x0626, 0x04},
-	{0x0627, 0x38},
-	{0x455e, 0x00},
-	{0x471e, 0x4b},
-	{0x4767, 0x0f},
-	{0x4750, 0x14},
-	{0x4540, 0x00},
-	{0x47b4, 0x14},
-	{0x4713, 0x30},
-	{0x478b, 0x10},
-	{0x478f, 0x10},
-	{0x4793, 0x10},
-	{0x4797, 0x0e},
-	{0x479b, 0x0e},
-	{0x0162, 0x0d},
-	{0x0163, 0x78},
+static const u8 mode_1640x1232_bursts[] = {
+	imx307_BURST(0x0100, 1), 0x00,
+	imx307_BURST(0x30eb, 1), 0x0c,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x300a, 2),
+		0xff, 0xff,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x09,
+	imx307_BURST(0x0114, 1), 0x01,
+	imx307_BURST(0x0128, 1), 0x00,
+	imx307_BURST(0x012a, 2),
+		0x18, 0x00,
+	imx307_BURST(0x0162, 16),
+		0x0d, 0x78, 0x00, 0x00, 0x0c, 0xcf, 0x00, 0x00,
+		0x09, 0x9f, 0x06, 0x68, 0x04, 0xd0, 0x01, 0x01,
+	imx307_BURST(0x0174, 2),
+		0x01, 0x01,
+	imx307_BURST(0x0301, 1), 0x05,
+	imx307_BURST(0x0303, 5),
+		0x01, 0x03, 0x03, 0x00, 0x39,
+	imx307_BURST(0x030b, 3),
+		0x01, 0x00, 0x72,
+	imx307_BURST(0x0624, 4),
+		0x06, 0x68, 0x04, 0xd0,
+	imx307_BURST(0x4540, 1), 0x00,
+	imx307_BURST(0x455e, 1), 0x00,
+	imx307_BURST(0x4713, 1), 0x30,
+	imx307_BURST(0x471e, 1), 0x4b,
+	imx307_BURST(0x4750, 1), 0x14,
+	imx307_BURST(0x4767, 1), 0x0f,
+	imx307_BURST(0x478b, 1), 0x10,
+	imx307_BURST(0x478f, 1), 0x10,
+	imx307_BURST(0x4793, 1), 0x10,
+	imx307_BURST(0x4797, 1), 0x0e,
+	imx307_BURST(0x479b, 1), 0x0e,
+	imx307_BURST(0x47b4, 1), 0x14,
 };
 
-static const struct imx307_reg mode_1640_1232_regs[] = {
-	{0x0100, 0x00},
-	{0x30eb, 0x0c},
-	{0x30eb, 0x05},
-	{0x300a, 0xff},
-	{0x300b, 0xff},
-	{0x30eb, 0x05},
-	{0x30eb, 0x09},
-	{0x0114, 0x01},
-	{0x0128, 0x00},
-	{0x012a, 0x18},
-	{0x012b, 0x00},
-	{0x0164, 0x00},
-	{0x0165, 0x00},
-	{0x0166, 0x0c},
-	{0x0167, 0xcf},
-	{0x0168, 0x00},
-	{0x0169, 0x00},
-	{0x016a, 0x09},
-	{0x016b, 0x9f},
-	{0x016c, 0x06},
-	{0x016d, 0x68},
-	{0x016e, 0x04},
-	{0x016f, 0xd0},
-	{0x0170, 0x01},
-	{0x0171, 0x01},
-	{0x0174, 0x01},
-	{0x0175, 0x01},
-	{0x0301, 0x05},
-	{0x0303, 0x01},
-	{0x0304, 0x03},
-	{0x0305, 0x03},
-	{0x0306, 0x00},
-	{0x0307, 0x39},
-	{0x030b, 0x01},
-	{0x030c, 0x00},
-	{0x030d, 0x72},
-	{0x0624, 0x06},
-	{0x0625, 0x68},
-	{0x0626, 0x04},
-	{0x0627, 0xd0},
-	{0x455e, 0x00},
-	{0x471e, 0x4b},
-	{0x4767, 0x0f},
-	{0x4750, 0x14},
-	{0x4540, 0x00},
-	{0x47b4, 0x14},
-	{0x4713, 0x30},
-	{0x478b, 0x10},
-	{0x478f, 0x10},
-	{0x4793, 0x10},
-	{0x4797, 0x0e},
-	{0x479b, 0x0e},
-	{0x0162, 0x0d},
-	{0x0163, 0x78},
+static const u8 mode_640x480_bursts[] = {
+	imx307_BURST(0x0100, 1), 0x00,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x0c,
+	imx307_BURST(0x300a, 2),
+		0xff, 0xff,
+	imx307_BURST(0x30eb, 1), 0x05,
+	imx307_BURST(0x30eb, 1), 0x09,
+	imx307_BURST(0x0114, 1), 0x01,
+	imx307_BURST(0x0128, 1), 0x00,
+	imx307_BURST(0x012a, 2),
+		0x18, 0x00,
+	imx307_BURST(0x0162, 16),
+		0x0d, 0x78, 0x03, 0xe8, 0x08, 0xe7, 0x02, 0xf0,
+		0x06, 0xaf, 0x02, 0x80, 0x01, 0xe0, 0x01, 0x01,
+	imx307_BURST(0x0174, 2),
+		0x03, 0x03,
+	imx307_BURST(0x0301, 1), 0x05,
+	imx307_BURST(0x0303, 5),
+		0x01, 0x03, 0x03, 0x00, 0x39,
+	imx307_BURST(0x030b, 3),
+		0x01, 0x00, 0x72,
+	imx307_BURST(0x0624, 4),
+		0x06, 0x68, 0x04, 0xd0,
+	imx307_BURST(0x4540, 1), 0x00,
+	imx307_BURST(0x455e, 1), 0x00,
+	imx307_BURST(0x4713, 1), 0x30,
+	imx307_BURST(0x471e, 1), 0x4b,
+	imx307_BURST(0x4750, 1), 0x14,
+	imx307_BURST(0x4767, 1), 0x0f,
+	imx307_BURST(0x478b, 1), 0x10,
+	imx307_BURST(0x478f, 1), 0x10,
+	imx307_BURST(0x4793, 1), 0x10,
+	imx307_BURST(0x4797, 1), 0x0e,
+	imx307_BURST(0x479b, 1), 0x0e,
+	imx307_BURST(0x47b4, 1), 0x14,
 };
 
-static const struct imx307_reg mode_640_480_regs[] = {
-	{0x0100, 0x00},
-	{0x30eb, 0x05},
-	{0x30eb, 0x0c},
-	{0x300a, 0xff},
-	{0x300b, 0xff},
-	{0x30eb, 0x05},
-	{0x30eb, 0x09},
-	{0x0114, 0x01},
-	{0x0128, 0x00},
-	{0x012a, 0x18},
-	{0x012b, 0x00},
-	{0x0162, 0x0d},
-	{0x0163, 0x78},
-	{0x0164, 0x03},
-	{0x0165, 0xe8},
-	{0x0166, 0x08},
-	{0x0167, 0xe7},
-	{0x0168, 0x02},
-	{0x0169, 0xf0},
-	{0x016a, 0x06},
-	{0x016b, 0xaf},
-	{0x016c, 0x02},
-	{0x016d, 0x80},
-	{0x016e, 0x01},
-	{0x016f, 0xe0},
-	{0x0170, 0x01},
-	{0x0171, 0x01},
-	{0x0174, 0x03},
-	{0x0175, 0x03},
-	{0x0301, 0x05},
-	{0x0303, 0x01},
-	{0x0304, 0x03},
-	{0x0305, 0x03},
-	{0x0306, 0x00},
-	{0x0307, 0x39},
-	{0x030b, 0x01},
-	{0x030c, 0x00},
-	{0x030d, 0x72},
-	{0x0624, 0x06},
-	{0x0625, 0x68},
-	{0x0626, 0x04},
-	{0x0627, 0xd0},
-	{0x455e, 0x00},
-	{0x471e, 0x4b},
-	{0x4767, 0x0f},
-	{0x4750, 0x14},
-	{0x4540, 0x00},
-	{0x47b4, 0x14},
-	{0x4713, 0x30},
-	{0x478b, 0x10},
-	{0x478f, 0x10},
-	{0x4793, 0x10},
-	{0x4797, 0x0e},
-	{0x479b, 0x0e},
+static const u8 raw8_framefmt_bursts[] = {
+	imx307_BURST(0x018c, 2),
+		0x08, 0x08,
+	imx307_BURST(0x0309, 1), 0x08,
 };
 
-static const struct imx307_reg raw8_framefmt_regs[] = {
-	{0x018c, 0x08},
-	{0x018d, 0x08},
-	{0x0309, 0x08},
+static const u8 raw10_framefmt_bursts[] = {
+	imx307_BURST(0x018c, 2),
+		0x0a, 0x0a,
+	imx307_BURST(0x0309, 1), 0x0a,
 };
 
-static const struct imx307_reg raw10_framefmt_regs[] = {
-	{0x018c, 0x0a},
-	{0x018d, 0x0a},
-	{0x0309, 0x0a},
+static const struct imx307_burst_list imx307_framefmt_bursts[] = {
+	[imx307_FRAMEFMT_RAW8] = {
+		.len = ARRAY_SIZE(raw8_framefmt_bursts),
+		.data = raw8_framefmt_bursts,
+	},
+	[imx307_FRAMEFMT_RAW10] = {
+		.len = ARRAY_SIZE(raw10_framefmt_bursts),
+		.data = raw10_framefmt_bursts,
+	},
 };
 
 static const char * const imx307_test_pattern_menu[] = {
@@ -412,6 +510,69 @@ static const int imx307_test_pattern_val[] = {
 	imx307_TEST_PATTERN_PN9,
 };
 
+/*
+ * Analogue gain code for each 0.1 dB step, gain = 256 / (256 - code).
+ * Generated with round(256 - 256 / 10^(dB / 20)).
+ */
+static const u16 imx307_ana_gain_db[imx307_ANA_GAIN_DB_MAX + 1] = {
+	  0,   3,   6,   9,  12,  14,  17,  20,  23,  25,  28,  30,
+	 33,  36,  38,  41,  43,  46,  48,  50,  53,  55,  57,  60,
+	 62,  64,  66,  68,  71,  73,  75,  77,  79,  81,  83,  85,
+	 87,  89,  91,  93,  94,  96,  98, 100, 102, 104, 105, 107,
+	109, 110, 112, 114, 115, 117, 119, 120, 122, 123, 125, 126,
+	128, 129, 131, 132, 133, 135, 136, 138, 139, 140, 142, 143,
+	144, 146, 147, 148, 149, 151, 152, 153, 154, 155, 156, 158,
+	159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170,
+	171, 172, 173, 174, 175, 176, 177, 178, 179, 180, 180, 181,
+	182, 183, 184, 185, 185, 186, 187, 188, 189, 189, 190, 191,
+	192, 192, 193, 194, 195, 195, 196, 197, 197, 198, 199, 199,
+	200, 201, 201, 202, 203, 203, 204, 204, 205, 206, 206, 207,
+	207, 208, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213,
+	214, 214, 214, 215, 215, 216, 216, 217, 217, 218, 218, 219,
+	219, 219, 220, 220, 221, 221, 221, 222, 222, 223, 223, 223,
+	224, 224, 225, 225, 225, 226, 226, 226, 227, 227, 227, 228,
+	228, 228, 229, 229, 229, 230, 230, 230, 230, 231, 231, 231,
+	232, 232,
+};
+
+/*
+ * Digital gain code for each 0.1 dB step, gain = code / 256.
+ * Generated with round(256 * 10^(dB / 20)).
+ */
+static const u16 imx307_dgtl_gain_db[imx307_DGTL_GAIN_DB_MAX + 1] = {
+	0x100, 0x103, 0x106, 0x109, 0x10c, 0x10f, 0x112, 0x115,
+	0x119, 0x11c, 0x11f, 0x123, 0x126, 0x129, 0x12d, 0x130,
+	0x134, 0x137, 0x13b, 0x13f, 0x142, 0x146, 0x14a, 0x14e,
+	0x151, 0x155, 0x159, 0x15d, 0x161, 0x165, 0x16a, 0x16e,
+	0x172, 0x176, 0x17b, 0x17f, 0x183, 0x188, 0x18c, 0x191,
+	0x196, 0x19a, 0x19f, 0x1a4, 0x1a9, 0x1ae, 0x1b3, 0x1b8,
+	0x1bd, 0x1c2, 0x1c7, 0x1cd, 0x1d2, 0x1d7, 0x1dd, 0x1e2,
+	0x1e8, 0x1ed, 0x1f3, 0x1f9, 0x1ff, 0x205, 0x20b, 0x211,
+	0x217, 0x21d, 0x223, 0x22a, 0x230, 0x237, 0x23d, 0x244,
+	0x24a, 0x251, 0x258, 0x25f, 0x266, 0x26d, 0x274, 0x27c,
+	0x283, 0x28a, 0x292, 0x29a, 0x2a1, 0x2a9, 0x2b1, 0x2b9,
+	0x2c1, 0x2c9, 0x2d2, 0x2da, 0x2e2, 0x2eb, 0x2f4, 0x2fc,
+	0x305, 0x30e, 0x317, 0x320, 0x32a, 0x333, 0x33c, 0x346,
+	0x350, 0x35a, 0x363, 0x36d, 0x378, 0x382, 0x38c, 0x397,
+	0x3a1, 0x3ac, 0x3b7, 0x3c2, 0x3cd, 0x3d9, 0x3e4, 0x3ef,
+	0x3fb, 0x407, 0x413, 0x41f, 0x42b, 0x438, 0x444, 0x451,
+	0x45d, 0x46a, 0x478, 0x485, 0x492, 0x4a0, 0x4ad, 0x4bb,
+	0x4c9, 0x4d7, 0x4e6, 0x4f4, 0x503, 0x512, 0x521, 0x530,
+	0x540, 0x54f, 0x55f, 0x56f, 0x57f, 0x58f, 0x5a0, 0x5b0,
+	0x5c1, 0x5d2, 0x5e3, 0x5f5, 0x607, 0x618, 0x62a, 0x63d,
+	0x64f, 0x662, 0x675, 0x688, 0x69b, 0x6af, 0x6c3, 0x6d7,
+	0x6eb, 0x700, 0x714, 0x729, 0x73f, 0x754, 0x76a, 0x780,
+	0x796, 0x7ac, 0x7c3, 0x7da, 0x7f1, 0x809, 0x821, 0x839,
+	0x851, 0x86a, 0x883, 0x89c, 0x8b6, 0x8cf, 0x8ea, 0x904,
+	0x91f, 0x93a, 0x955, 0x971, 0x98d, 0x9a9, 0x9c6, 0x9e3,
+	0xa00, 0xa1e, 0xa3c, 0xa5a, 0xa79, 0xa98, 0xab7, 0xad7,
+	0xaf7, 0xb17, 0xb38, 0xb5a, 0xb7b, 0xb9d, 0xbc0, 0xbe3,
+	0xc06, 0xc29, 0xc4d, 0xc72, 0xc97, 0xcbc, 0xce2, 0xd08,
+	0xd2f, 0xd56, 0xd7d, 0xda5, 0xdce, 0xdf7, 0xe20, 0xe4a,
+	0xe74, 0xe9f, 0xecb, 0xef6, 0xf23, 0xf50, 0xf7d, 0xfab,
+	0xfd9,
+};
+
 /* regulator supplies */
 static const char * const imx307_supply_name[] = {
 	/* Supplies can be enabled in any order */
@@ -470,6 +631,67 @@ static const u32 codes[] = {
 #define imx307_XCLR_MIN_DELAY_US	6200
 #define imx307_XCLR_DELAY_RANGE_US	1000
 
+/*
+ * Keep the sensor powered for a while after streaming stops, so that a
+ * restart with the same mode only has to set the streaming bit.
+ */
+#define imx307_AUTOSUSPEND_DELAY_MS	1000
+
+/*
+ * Failed I2C transactions are retried with an exponential backoff starting
+ * at imx307_I2C_RETRY_DELAY_US and capped at imx307_I2C_RETRY_DELAY_MAX_US.
+ */
+#define imx307_I2C_RETRY_DELAY_US	100
+#define imx307_I2C_RETRY_DELAY_MAX_US	2000
+
+static unsigned int i2c_max_retries = 3;
+module_param(i2c_max_retries, uint, 0644);
+MODULE_PARM_DESC(i2c_max_retries,
+		 "Number of times a failed I2C transaction is retried");
+
+static bool i2c_bus_recovery;
+module_param(i2c_bus_recovery, bool, 0644);
+MODULE_PARM_DESC(i2c_bus_recovery,
+		 "Attempt I2C bus recovery before retrying a failed transaction");
+
+/*
+ * The stream watchdog samples the frame counter every watchdog_ms while
+ * streaming. The period must cover at least one frame at the slowest frame
+ * rate in use, otherwise a healthy sensor is reported as stalled.
+ */
+static unsigned int watchdog_ms;
+module_param(watchdog_ms, uint, 0644);
+MODULE_PARM_DESC(watchdog_ms,
+		 "Stream watchdog period in ms, 0 to disable (default)");
+
+/*
+ * Power the sensor up at open rather than at stream start. The XCLR delay
+ * and the register table writes then happen while the application is
+ * still setting up, rather than between STREAMON and the first frame.
+ */
+static bool power_on_open;
+module_param(power_on_open, bool, 0444);
+MODULE_PARM_DESC(power_on_open,
+		 "Power up and program the sensor when the subdev is opened");
+
+/*
+ * With frame_sync_ctrls set, control writes made while streaming are held
+ * back and sent from a real-time worker just after the next frame starts,
+ * inside a group hold. A control set while frame N is being read out then
+ * always applies from frame N + imx307_CTRL_LATENCY_FRAMES, wherever in the
+ * frame the ioctl happened to land.
+ *
+ * Frame starts come from the XVS interrupt if available, and are otherwise
+ * modelled from the frame length. The model is not locked to the sensor,
+ * so without XVS the latency is only fixed as long as it does not drift.
+ */
+#define imx307_CTRL_LATENCY_FRAMES	2
+
+static bool frame_sync_ctrls;
+module_param(frame_sync_ctrls, bool, 0444);
+MODULE_PARM_DESC(frame_sync_ctrls,
+		 "Apply control changes on frame boundaries while streaming");
+
 /* Mode configs */
 static const struct imx307_mode supported_modes[] = {
 	{
@@ -483,9 +705,9 @@ static const struct imx307_mode supported_modes[] = {
 			.height = 2464
 		},
 		.vts_def = imx307_VTS_15FPS,
-		.reg_list = {
-			.num_of_regs = ARRAY_SIZE(mode_3280x2464_regs),
-			.regs = mode_3280x2464_regs,
+		.bursts = {
+			.len = ARRAY_SIZE(mode_3280x2464_bursts),
+			.data = mode_3280x2464_bursts,
 		},
 	},
 	{
@@ -499,9 +721,9 @@ static const struct imx307_mode supported_modes[] = {
 			.height = 1080
 		},
 		.vts_def = imx307_VTS_30FPS_1080P,
-		.reg_list = {
-			.num_of_regs = ARRAY_SIZE(mode_1920_1080_regs),
-			.regs = mode_1920_1080_regs,
+		.bursts = {
+			.len = ARRAY_SIZE(mode_1920x1080_bursts),
+			.data = mode_1920x1080_bursts,
 		},
 	},
 	{
@@ -515,9 +737,9 @@ static const struct imx307_mode supported_modes[] = {
 			.height = 2464
 		},
 		.vts_def = imx307_VTS_30FPS_BINNED,
-		.reg_list = {
-			.num_of_regs = ARRAY_SIZE(mode_1640_1232_regs),
-			.regs = mode_1640_1232_regs,
+		.bursts = {
+			.len = ARRAY_SIZE(mode_1640x1232_bursts),
+			.data = mode_1640x1232_bursts,
 		},
 	},
 	{
@@ -531,9 +753,9 @@ static const struct imx307_mode supported_modes[] = {
 			.height = 960
 		},
 		.vts_def = imx307_VTS_30FPS_640x480,
-		.reg_list = {
-			.num_of_regs = ARRAY_SIZE(mode_640_480_regs),
-			.regs = mode_640_480_regs,
+		.bursts = {
+			.len = ARRAY_SIZE(mode_640x480_bursts),
+			.data = mode_640x480_bursts,
 		},
 	},
 };
@@ -548,12 +770,32 @@ struct imx307 {
 	u32 xclk_freq;
 
 	struct gpio_desc *reset_gpio;
+
+	/* CSI-2 bus configuration from the endpoint */
+	unsigned int num_data_lanes;
+	unsigned int csi2_flags;
+
+	/* Optional XVS (vertical sync) input */
+	struct gpio_desc *xvs_gpio;
+	int xvs_irq;
+	bool xvs_enabled;
+	/* Sequence number and time of the last XVS edge */
+	u32 frame_sequence;
+	ktime_t xvs_time;
+	/* Time at which XCLR was last released */
+	ktime_t xclr_time;
 	struct regulator_bulk_data supplies[imx307_NUM_SUPPLIES];
 
 	struct v4l2_ctrl_handler ctrl_handler;
 	/* V4L2 Controls */
 	struct v4l2_ctrl *pixel_rate;
 	struct v4l2_ctrl *exposure;
+	struct v4l2_ctrl *exposure_abs;
+	struct v4l2_ctrl *exposure_us;
+	struct v4l2_ctrl *again;
+	struct v4l2_ctrl *dgain;
+	struct v4l2_ctrl *gain_db;
+	struct v4l2_ctrl *auto_frame_length;
 	struct v4l2_ctrl *vflip;
 	struct v4l2_ctrl *hflip;
 	struct v4l2_ctrl *vblank;
@@ -562,6 +804,13 @@ struct imx307 {
 	/* Current mode */
 	const struct imx307_mode *mode;
 
+	/* Supported modes, either built in or loaded from firmware */
+	const struct imx307_mode *modes;
+	unsigned int num_modes;
+
+	/* Frame format tables, either built in or loaded from firmware */
+	struct imx307_burst_list framefmt_bursts[imx307_NUM_FRAMEFMTS];
+
 	/*
 	 * Mutex for serialized access:
 	 * Protect sensor module set pad format and start/stop streaming safely.
@@ -570,6 +819,78 @@ struct imx307 {
 
 	/* Streaming on/off */
 	bool streaming;
+
+	/* Control register writes are queued rather than sent while set */
+	bool batching;
+	struct imx307_reg_queue queue;
+
+	/*
+	 * Mode and frame format currently programmed into the sensor, NULL
+	 * and -1 if the sensor needs a full table load.
+	 */
+	const struct imx307_mode *programmed_mode;
+	int programmed_framefmt;
+
+	/* Set while the exposure time controls follow V4L2_CID_EXPOSURE */
+	bool exposure_sync;
+	/* Set while the gain controls are being synced with each other */
+	bool gain_sync;
+
+	/* Control register values known to be in the sensor */
+	struct imx307_cached_reg cached_regs[imx307_NUM_CACHED_REGS];
+	unsigned int num_cached_regs;
+
+	/* Frame boundary control scheduler, see frame_sync_ctrls */
+	bool sched_active;
+	/* Protects sched_queue */
+	struct mutex sched_lock;
+	struct imx307_reg_queue sched_queue;
+	/* A scheduled transfer failed, the cache must be dropped */
+	bool sched_failed;
+	struct kthread_worker *sched_worker;
+	struct kthread_work sched_work;
+	/* Modelled vsync used when there is no XVS interrupt */
+	struct hrtimer vsync_timer;
+	u64 frame_period_ns;
+	/* Set while frame starts kick the scheduler worker */
+	bool vsync_active;
+
+	/* Bracketing sequence, protected by sched_lock */
+	struct imx307_bracket_frame bracket[imx307_BRACKET_MAX_FRAMES];
+	unsigned int bracket_len;
+	unsigned int bracket_pos;
+
+	/*
+	 * Triggered capture: while armed the sensor waits programmed in
+	 * standby, and each trigger streams trigger_frames frames, counted
+	 * on XVS. trigger_mode is NULL without an XVS input.
+	 */
+	struct gpio_desc *trigger_gpio;
+	int trigger_irq;
+	struct v4l2_ctrl *trigger_mode;
+	u32 trigger_frames;
+	bool trigger_armed;
+	/* Set from the trigger until the sensor is back in standby */
+	atomic_t trigger_busy;
+	atomic_t trigger_frames_left;
+	/* Number of frames of the capture in progress */
+	u32 trigger_count;
+	ktime_t trigger_time;
+	u32 trigger_latency_us;
+	struct kthread_work trigger_work;
+	struct kthread_work trigger_stop_work;
+
+	/* File handles holding a runtime PM reference, see power_on_open */
+	struct list_head open_power_fhs;
+
+	/* Stream watchdog */
+	struct delayed_work watchdog_work;
+	u32 watchdog_frame_count;
+
+	/* I2C bus health counters, exported through sysfs */
+	atomic_t i2c_retries;
+	atomic_t i2c_recoveries;
+	atomic_t i2c_failures;
 };
 
 static inline struct imx307 *to_imx307(struct v4l2_subdev *_sd)
@@ -577,6 +898,40 @@ static inline struct imx307 *to_imx307(struct v4l2_subdev *_sd)
 	return container_of(_sd, struct imx307, sd);
 }
 
+/*
+ * Issue an I2C transfer, retrying failed attempts with exponential backoff
+ * and, if enabled, an adapter bus recovery in between.
+ */
+static int imx307_transfer(struct imx307 *imx307, struct i2c_msg *msgs,
+			   int num)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	unsigned int delay_us = imx307_I2C_RETRY_DELAY_US;
+	unsigned int attempt;
+	int ret;
+
+	for (attempt = 0; ; attempt++) {
+		ret = i2c_transfer(client->adapter, msgs, num);
+		if (ret == num)
+			return 0;
+
+		if (attempt >= i2c_max_retries)
+			break;
+
+		atomic_inc(&imx307->i2c_retries);
+		if (i2c_bus_recovery && !i2c_recover_bus(client->adapter))
+			atomic_inc(&imx307->i2c_recoveries);
+
+		usleep_range(delay_us, delay_us * 2);
+		delay_us = min_t(unsigned int, delay_us * 2,
+				 imx307_I2C_RETRY_DELAY_MAX_US);
+	}
+
+	atomic_inc(&imx307->i2c_failures);
+
+	return ret < 0 ? ret : -EIO;
+}
+
 /* Read registers up to 2 at a time */
 static int imx307_read_reg(struct imx307 *imx307, u16 reg, u32 len, u32 *val)
 {
@@ -601,9 +956,9 @@ static int imx307_read_reg(struct imx307 *imx307, u16 reg, u32 len, u32 *val)
 	msgs[1].len = len;
 	msgs[1].buf = &data_buf[4 - len];
 
-	ret = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
-	if (ret != ARRAY_SIZE(msgs))
-		return -EIO;
+	ret = imx307_transfer(imx307, msgs, ARRAY_SIZE(msgs));
+	if (ret)
+		return ret;
 
 	*val = get_unaligned_be32(data_buf);
 
@@ -614,6 +969,7 @@ static int imx307_read_reg(struct imx307 *imx307, u16 reg, u32 len, u32 *val)
 static int imx307_write_reg(struct imx307 *imx307, u16 reg, u32 len, u32 val)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct i2c_msg msg;
 	u8 buf[6];
 
 	if (len > 4)
@@ -621,26 +977,58 @@ static int imx307_write_reg(struct imx307 *imx307, u16 reg, u32 len, u32 val)
 
 	put_unaligned_be16(reg, buf);
 	put_unaligned_be32(val << (8 * (4 - len)), buf + 2);
-	if (i2c_master_send(client, buf, len + 2) != len + 2)
-		return -EIO;
 
-	return 0;
+	msg.addr = client->addr;
+	msg.flags = 0;
+	msg.len = len + 2;
+	msg.buf = buf;
+
+	return imx307_transfer(imx307, &msg, 1);
 }
 
-/* Write a list of registers */
-static int imx307_write_regs(struct imx307 *imx307,
-			     const struct imx307_reg *regs, u32 len)
+/* Forget cached control registers overlapping [start, end) */
+static void imx307_invalidate_cache(struct imx307 *imx307, u32 start, u32 end)
 {
-	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct imx307_cached_reg *cached;
 	unsigned int i;
+
+	for (i = 0; i < imx307->num_cached_regs; i++) {
+		cached = &imx307->cached_regs[i];
+		if (cached->address + cached->len > start &&
+		    cached->address < end)
+			cached->valid = false;
+	}
+}
+
+/*
+ * Write a list of burst segments, one I2C message per segment. Every
+ * segment is retried on its own, so a transient error resumes the table
+ * from the failing segment instead of aborting or restarting it.
+ */
+static int imx307_write_bursts(struct imx307 *imx307,
+			       const struct imx307_burst_list *list)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct i2c_msg msg = {
+		.addr = client->addr,
+		.flags = 0,
+	};
+	unsigned int pos;
 	int ret;
 
-	for (i = 0; i < len; i++) {
-		ret = imx307_write_reg(imx307, regs[i].address, 1, regs[i].val);
+	for (pos = 0; pos < list->len; pos += msg.len + 1) {
+		msg.len = list->data[pos] + 2;
+		msg.buf = (u8 *)&list->data[pos + 1];
+
+		imx307_invalidate_cache(imx307, get_unaligned_be16(msg.buf),
+					get_unaligned_be16(msg.buf) +
+					msg.len - 2);
+
+		ret = imx307_transfer(imx307, &msg, 1);
 		if (ret) {
 			dev_err_ratelimited(&client->dev,
 					    "Failed to write reg 0x%4.4x. error = %d\n",
-					    regs[i].address, ret);
+					    get_unaligned_be16(msg.buf), ret);
 
 			return ret;
 		}
@@ -649,6 +1037,302 @@ static int imx307_write_regs(struct imx307 *imx307,
 	return 0;
 }
 
+/* Send all queued register writes in one transfer */
+static int imx307_flush_queue(struct imx307 *imx307,
+			      struct imx307_reg_queue *queue)
+{
+	int ret = 0;
+
+	if (queue->num_msgs)
+		ret = imx307_transfer(imx307, queue->msgs, queue->num_msgs);
+
+	/*
+	 * Queued writes may or may not have reached the sensor. The cache is
+	 * protected by the mutex, which the scheduler worker does not hold,
+	 * so its failures are left for imx307_write_ctrl_reg() to act on.
+	 */
+	if (ret && queue == &imx307->sched_queue)
+		WRITE_ONCE(imx307->sched_failed, true);
+	else if (ret)
+		imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
+
+	queue->num_msgs = 0;
+	queue->len = 0;
+
+	return ret;
+}
+
+/*
+ * Drop all queued register writes. The cache already counts them as
+ * written, so forget everything it holds.
+ */
+static void imx307_discard_queue(struct imx307 *imx307,
+				 struct imx307_reg_queue *queue)
+{
+	queue->num_msgs = 0;
+	queue->len = 0;
+
+	imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
+}
+
+/*
+ * Queue a register write. If merge is set, a write to a register that is
+ * already queued replaces the queued value. A write to the address
+ * following the last queued message extends that message into a burst.
+ */
+static int __imx307_queue_reg(struct imx307 *imx307,
+			      struct imx307_reg_queue *queue, u16 reg, u32 len,
+			      u32 val, bool merge)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct i2c_msg *msg;
+	unsigned int i;
+	u8 *data = NULL;
+	int ret;
+
+	if (len > 4)
+		return -EINVAL;
+
+	for (i = 0; merge && i < queue->num_msgs; i++) {
+		u16 start;
+
+		msg = &queue->msgs[i];
+		start = get_unaligned_be16(msg->buf);
+		if (reg >= start && reg + len <= start + msg->len - 2) {
+			data = msg->buf + 2 + reg - start;
+			break;
+		}
+	}
+
+	if (!data && queue->num_msgs) {
+		msg = &queue->msgs[queue->num_msgs - 1];
+		if (get_unaligned_be16(msg->buf) + msg->len - 2 == reg &&
+		    queue->len + len <= imx307_QUEUE_BUF_SIZE) {
+			data = &queue->buf[queue->len];
+			msg->len += len;
+			queue->len += len;
+		}
+	}
+
+	if (!data) {
+		if (queue->num_msgs == imx307_QUEUE_MAX_MSGS ||
+		    queue->len + len + 2 > imx307_QUEUE_BUF_SIZE) {
+			ret = imx307_flush_queue(imx307, queue);
+			if (ret)
+				return ret;
+		}
+
+		msg = &queue->msgs[queue->num_msgs++];
+		msg->addr = client->addr;
+		msg->flags = 0;
+		msg->len = len + 2;
+		msg->buf = &queue->buf[queue->len];
+		put_unaligned_be16(reg, msg->buf);
+		data = msg->buf + 2;
+		queue->len += len + 2;
+	}
+
+	for (i = 0; i < len; i++)
+		data[i] = val >> (8 * (len - 1 - i));
+
+	return 0;
+}
+
+/*
+ * Start batching register writes inside a group hold, so that they all
+ * latch on the same frame.
+ */
+static int imx307_hold_begin(struct imx307 *imx307)
+{
+	int ret;
+
+	imx307->batching = true;
+
+	ret = __imx307_queue_reg(imx307, &imx307->queue, imx307_REG_GROUP_HOLD,
+				 imx307_REG_VALUE_08BIT, 1, false);
+	if (ret) {
+		imx307->batching = false;
+		imx307_discard_queue(imx307, &imx307->queue);
+	}
+
+	return ret;
+}
+
+/*
+ * Release the group hold and send the batch in one transfer. If ret holds
+ * an error from filling the batch, the batch is dropped instead, and the
+ * hold released on its own in case a full queue already sent part of it.
+ */
+static int imx307_hold_end(struct imx307 *imx307, int ret)
+{
+	if (!ret)
+		ret = __imx307_queue_reg(imx307, &imx307->queue,
+					 imx307_REG_GROUP_HOLD,
+					 imx307_REG_VALUE_08BIT, 0, false);
+
+	imx307->batching = false;
+
+	if (!ret)
+		return imx307_flush_queue(imx307, &imx307->queue);
+
+	imx307_discard_queue(imx307, &imx307->queue);
+	imx307_write_reg(imx307, imx307_REG_GROUP_HOLD,
+			 imx307_REG_VALUE_08BIT, 0);
+
+	return ret;
+}
+
+/*
+ * Queue a register write for the next frame boundary. The writes of one
+ * frame are bracketed by a group hold so that they all latch together.
+ * Called with sched_lock held.
+ */
+static int __imx307_sched_reg(struct imx307 *imx307, u16 reg, u32 len,
+			      u32 val)
+{
+	struct imx307_reg_queue *queue = &imx307->sched_queue;
+	int ret;
+
+	/*
+	 * Flushing early would send part of a frame's writes off the frame
+	 * boundary, so refuse a write that might not leave room to release
+	 * the hold. With at most one message per control register this does
+	 * not happen.
+	 */
+	if (queue->num_msgs + 2 > imx307_QUEUE_MAX_MSGS ||
+	    queue->len + (len + 2) + (imx307_REG_VALUE_08BIT + 2) >
+	    imx307_QUEUE_BUF_SIZE)
+		return -ENOSPC;
+
+	if (!queue->num_msgs) {
+		ret = __imx307_queue_reg(imx307, queue, imx307_REG_GROUP_HOLD,
+					 imx307_REG_VALUE_08BIT, 1, false);
+		if (ret)
+			return ret;
+	}
+
+	return __imx307_queue_reg(imx307, queue, reg, len, val, true);
+}
+
+static int imx307_sched_reg(struct imx307 *imx307, u16 reg, u32 len, u32 val)
+{
+	int ret;
+
+	mutex_lock(&imx307->sched_lock);
+	ret = __imx307_sched_reg(imx307, reg, len, val);
+	mutex_unlock(&imx307->sched_lock);
+
+	return ret;
+}
+
+/*
+ * Schedule the next frame of the bracketing sequence, overriding any
+ * exposure, gain and frame length writes already scheduled. Called with
+ * sched_lock held.
+ */
+static int imx307_sched_bracket(struct imx307 *imx307)
+{
+	const struct imx307_bracket_frame *frame;
+	int ret;
+
+	frame = &imx307->bracket[imx307->bracket_pos];
+	imx307->bracket_pos = (imx307->bracket_pos + 1) % imx307->bracket_len;
+
+	ret = __imx307_sched_reg(imx307, imx307_REG_VTS,
+				 imx307_REG_VALUE_16BIT, frame->vts);
+	if (!ret)
+		ret = __imx307_sched_reg(imx307, imx307_REG_EXPOSURE,
+					 imx307_REG_VALUE_16BIT,
+					 frame->exposure);
+	if (!ret)
+		ret = __imx307_sched_reg(imx307, imx307_REG_ANALOG_GAIN,
+					 imx307_REG_VALUE_08BIT, frame->again);
+	if (!ret)
+		ret = __imx307_sched_reg(imx307, imx307_REG_DIGITAL_GAIN,
+					 imx307_REG_VALUE_16BIT, frame->dgain);
+
+	return ret;
+}
+
+/*
+ * Send the writes scheduled for this frame boundary, releasing the hold.
+ * Called with sched_lock held.
+ */
+static int __imx307_sched_flush(struct imx307 *imx307)
+{
+	struct imx307_reg_queue *queue = &imx307->sched_queue;
+	int ret;
+
+	if (!queue->num_msgs)
+		return 0;
+
+	ret = __imx307_queue_reg(imx307, queue, imx307_REG_GROUP_HOLD,
+				 imx307_REG_VALUE_08BIT, 0, false);
+
+	return imx307_flush_queue(imx307, queue) ?: ret;
+}
+
+static int imx307_sched_flush(struct imx307 *imx307)
+{
+	int ret;
+
+	mutex_lock(&imx307->sched_lock);
+	ret = __imx307_sched_flush(imx307);
+	mutex_unlock(&imx307->sched_lock);
+
+	return ret;
+}
+
+/*
+ * Write a control register, queueing it if a batch is in progress or
+ * scheduling it for the next frame boundary while the control scheduler
+ * runs. The write is skipped if the register already holds the value.
+ */
+static int imx307_write_ctrl_reg(struct imx307 *imx307, u16 reg, u32 len,
+				 u32 val)
+{
+	struct imx307_cached_reg *cached = NULL;
+	unsigned int i;
+	int ret;
+
+	if (READ_ONCE(imx307->sched_failed)) {
+		WRITE_ONCE(imx307->sched_failed, false);
+		imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
+	}
+
+	for (i = 0; i < imx307->num_cached_regs; i++) {
+		if (imx307->cached_regs[i].address == reg) {
+			cached = &imx307->cached_regs[i];
+			break;
+		}
+	}
+
+	if (!cached && imx307->num_cached_regs < imx307_NUM_CACHED_REGS) {
+		cached = &imx307->cached_regs[imx307->num_cached_regs++];
+		cached->address = reg;
+		cached->len = len;
+		cached->valid = false;
+	}
+
+	if (cached && cached->valid && cached->val == val)
+		return 0;
+
+	if (imx307->batching)
+		ret = __imx307_queue_reg(imx307, &imx307->queue, reg, len, val,
+					 true);
+	else if (imx307->sched_active)
+		ret = imx307_sched_reg(imx307, reg, len, val);
+	else
+		ret = imx307_write_reg(imx307, reg, len, val);
+
+	if (cached) {
+		cached->valid = !ret;
+		cached->val = val;
+	}
+
+	return ret;
+}
+
 /* Get bayer order based on flip setting. */
 static u32 imx307_get_format_code(struct imx307 *imx307, u32 code)
 {
@@ -681,43 +1365,411 @@ static void imx307_set_default_format(struct imx307 *imx307)
 							  fmt->colorspace,
 							  fmt->ycbcr_enc);
 	fmt->xfer_func = V4L2_MAP_XFER_FUNC_DEFAULT(fmt->colorspace);
-	fmt->width = supported_modes[0].width;
-	fmt->height = supported_modes[0].height;
+	fmt->width = imx307->modes[0].width;
+	fmt->height = imx307->modes[0].height;
 	fmt->field = V4L2_FIELD_NONE;
 }
 
-static int imx307_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+/* Line time of the current mode in ns */
+static u32 imx307_line_time_ns(struct imx307 *imx307)
 {
-	struct imx307 *imx307 = to_imx307(sd);
-	struct v4l2_mbus_framefmt *try_fmt_img =
-		v4l2_subdev_get_try_format(sd, fh->pad, IMAGE_PAD);
-	struct v4l2_mbus_framefmt *try_fmt_meta =
-		v4l2_subdev_get_try_format(sd, fh->pad, METADATA_PAD);
-	struct v4l2_rect *try_crop;
+	return div_u64((u64)imx307_PPL_DEFAULT * NSEC_PER_SEC,
+		       imx307_PIXEL_RATE);
+}
 
-	mutex_lock(&imx307->mutex);
+/* Convert an exposure in lines to a time in units of unit_ns */
+static s32 imx307_lines_to_time(struct imx307 *imx307, u32 lines,
+				u32 unit_ns)
+{
+	return DIV_ROUND_CLOSEST_ULL((u64)lines * imx307_line_time_ns(imx307),
+				     unit_ns);
+}
 
-	/* Initialize try_fmt for the image pad */
-	try_fmt_img->width = supported_modes[0].width;
-	try_fmt_img->height = supported_modes[0].height;
-	try_fmt_img->code = imx307_get_format_code(imx307,
-						   MEDIA_BUS_FMT_SRGGB10_1X10);
-	try_fmt_img->field = V4L2_FIELD_NONE;
+/* Convert a time in units of unit_ns to an exposure in lines */
+static s32 imx307_time_to_lines(struct imx307 *imx307, u32 time, u32 unit_ns)
+{
+	return DIV_ROUND_CLOSEST_ULL((u64)time * unit_ns,
+				     imx307_line_time_ns(imx307));
+}
 
-	/* Initialize try_fmt for the embedded metadata pad */
-	try_fmt_meta->width = imx307_EMBEDDED_LINE_WIDTH;
-	try_fmt_meta->height = imx307_NUM_EMBEDDED_LINES;
-	try_fmt_meta->code = MEDIA_BUS_FMT_SENSOR_DATA;
-	try_fmt_meta->field = V4L2_FIELD_NONE;
+/*
+ * Make the exposure time controls match an exposure of the given number of
+ * lines. The control being set, if any, is updated in place.
+ */
+static void imx307_sync_exposure_time(struct imx307 *imx307,
+				      struct v4l2_ctrl *ctrl, u32 lines)
+{
+	struct v4l2_ctrl *time_ctrls[] = {
+		imx307->exposure_abs, imx307->exposure_us
+	};
+	static const u32 units_ns[] = {
+		imx307_EXPOSURE_ABS_UNIT_NS, NSEC_PER_USEC
+	};
+	unsigned int i;
+	s32 val;
+
+	imx307->exposure_sync = true;
+
+	for (i = 0; i < ARRAY_SIZE(time_ctrls); i++) {
+		val = imx307_lines_to_time(imx307, lines, units_ns[i]);
+		val = clamp_t(s32, val, time_ctrls[i]->minimum,
+			      time_ctrls[i]->maximum);
+		if (time_ctrls[i] == ctrl)
+			ctrl->val = val;
+		else
+			__v4l2_ctrl_s_ctrl(time_ctrls[i], val);
+	}
 
-	/* Initialize try_crop rectangle. */
-	try_crop = v4l2_subdev_get_try_crop(sd, fh->pad, 0);
-	try_crop->top = imx307_PIXEL_ARRAY_TOP;
-	try_crop->left = imx307_PIXEL_ARRAY_LEFT;
-	try_crop->width = imx307_PIXEL_ARRAY_WIDTH;
-	try_crop->height = imx307_PIXEL_ARRAY_HEIGHT;
+	imx307->exposure_sync = false;
+}
 
-	mutex_unlock(&imx307->mutex);
+/*
+ * Longest exposure allowed by the frame length. With auto frame length
+ * the frame is stretched to fit the exposure instead.
+ */
+static int imx307_exposure_max(struct imx307 *imx307)
+{
+	if (imx307->auto_frame_length->val)
+		return imx307_VTS_MAX - 4;
+
+	return imx307->mode->height + imx307->vblank->val - 4;
+}
+
+/* Frame length in lines needed for the current vblank and exposure */
+static u32 imx307_frame_length(struct imx307 *imx307)
+{
+	u32 frame_length = imx307->mode->height + imx307->vblank->val;
+
+	if (imx307->auto_frame_length->val)
+		frame_length = clamp_t(u32, imx307->exposure->val + 4,
+				       frame_length, imx307_VTS_MAX);
+
+	return frame_length;
+}
+
+/*
+ * Write exposure and frame length together. Outside of a batch or the
+ * control scheduler, which both hold the sensor already, the two are sent
+ * in one transfer inside a group hold, so that a frame length extended for
+ * a long exposure lands on the same frame as the exposure.
+ */
+static int imx307_write_frame_timing(struct imx307 *imx307)
+{
+	bool hold = !imx307->batching && !imx307->sched_active;
+	u32 frame_length = imx307_frame_length(imx307);
+	int ret;
+
+	/* Keep the modelled vsync in step with the new frame length */
+	WRITE_ONCE(imx307->frame_period_ns,
+		   (u64)frame_length * imx307_line_time_ns(imx307));
+
+	if (hold) {
+		ret = imx307_hold_begin(imx307);
+		if (ret)
+			return ret;
+	}
+
+	ret = imx307_write_ctrl_reg(imx307, imx307_REG_VTS,
+				    imx307_REG_VALUE_16BIT, frame_length);
+	if (!ret)
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_EXPOSURE,
+					    imx307_REG_VALUE_16BIT,
+					    imx307->exposure->val);
+
+	if (hold)
+		ret = imx307_hold_end(imx307, ret);
+
+	return ret;
+}
+
+/* Update the range of the exposure controls for a new maximum in lines */
+static void imx307_update_exposure_range(struct imx307 *imx307,
+					 int exposure_max)
+{
+	struct v4l2_ctrl *time_ctrls[] = {
+		imx307->exposure_abs, imx307->exposure_us
+	};
+	static const u32 units_ns[] = {
+		imx307_EXPOSURE_ABS_UNIT_NS, NSEC_PER_USEC
+	};
+	int exposure_def = min(exposure_max, imx307_EXPOSURE_DEFAULT);
+	int exposure_min = imx307->exposure->minimum;
+	unsigned int i;
+
+	__v4l2_ctrl_modify_range(imx307->exposure, exposure_min, exposure_max,
+				 imx307->exposure->step, exposure_def);
+
+	imx307->exposure_sync = true;
+
+	for (i = 0; i < ARRAY_SIZE(time_ctrls); i++)
+		__v4l2_ctrl_modify_range(time_ctrls[i],
+			max(imx307_lines_to_time(imx307, exposure_min,
+						 units_ns[i]), 1),
+			imx307_lines_to_time(imx307, exposure_max, units_ns[i]),
+			1,
+			imx307_lines_to_time(imx307, exposure_def, units_ns[i]));
+
+	imx307->exposure_sync = false;
+
+	imx307_sync_exposure_time(imx307, NULL, imx307->exposure->val);
+}
+
+/* Set the exposure in lines from one of the exposure time controls */
+static int imx307_set_exposure_time(struct imx307 *imx307,
+				    struct v4l2_ctrl *ctrl)
+{
+	u32 unit_ns = ctrl->id == V4L2_CID_EXPOSURE_ABSOLUTE ?
+		      imx307_EXPOSURE_ABS_UNIT_NS : NSEC_PER_USEC;
+	s32 lines;
+	int ret;
+
+	if (imx307->exposure_sync)
+		return 0;
+
+	/* Already matching, e.g. when replaying controls at stream start */
+	if (imx307_lines_to_time(imx307, imx307->exposure->val, unit_ns) ==
+	    ctrl->val)
+		return 0;
+
+	lines = imx307_time_to_lines(imx307, ctrl->val, unit_ns);
+	lines = clamp_t(s32, lines, imx307->exposure->minimum,
+			imx307->exposure->maximum);
+
+	ret = __v4l2_ctrl_s_ctrl(imx307->exposure, lines);
+	if (ret)
+		return ret;
+
+	imx307_sync_exposure_time(imx307, ctrl, lines);
+
+	return 0;
+}
+
+/*
+ * First step of a gain table whose code is at least code, or the last
+ * step. Neighbouring analogue steps can share a code, so this is the
+ * lowest step giving that gain.
+ */
+static unsigned int imx307_gain_db_step(const u16 *table, unsigned int max,
+					u32 code)
+{
+	unsigned int lo = 0, hi = max, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (table[mid] < code)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Analogue and digital gain codes for a combined gain in 0.1 dB */
+static void imx307_split_gain_db(u32 gain_db, u16 *again, u16 *dgain)
+{
+	unsigned int ana_db = min_t(u32, gain_db, imx307_ANA_GAIN_DB_MAX);
+
+	*again = imx307_ana_gain_db[ana_db];
+	*dgain = imx307_dgtl_gain_db[gain_db - ana_db];
+}
+
+/* Whether the analogue and digital gain controls give this combined gain */
+static bool imx307_gain_db_matches(struct imx307 *imx307, s32 gain_db)
+{
+	u16 again, dgain;
+
+	imx307_split_gain_db(gain_db, &again, &dgain);
+
+	return imx307->again->val == again && imx307->dgain->val == dgain;
+}
+
+/* Make the combined gain control follow the analogue and digital gains */
+static void imx307_sync_gain_db(struct imx307 *imx307)
+{
+	unsigned int ana_db, dgtl_db;
+
+	if (imx307->gain_sync)
+		return;
+
+	/* Keep the step that was set if it still gives the same codes */
+	if (imx307_gain_db_matches(imx307, imx307->gain_db->val))
+		return;
+
+	ana_db = imx307_gain_db_step(imx307_ana_gain_db,
+				     imx307_ANA_GAIN_DB_MAX,
+				     imx307->again->val);
+	dgtl_db = imx307_gain_db_step(imx307_dgtl_gain_db,
+				      imx307_DGTL_GAIN_DB_MAX,
+				      imx307->dgain->val);
+
+	imx307->gain_sync = true;
+	__v4l2_ctrl_s_ctrl(imx307->gain_db, ana_db + dgtl_db);
+	imx307->gain_sync = false;
+}
+
+/* Split the combined gain into analogue and digital gain */
+static int imx307_set_gain_db(struct imx307 *imx307, struct v4l2_ctrl *ctrl)
+{
+	u16 again, dgain;
+	int ret;
+
+	if (imx307->gain_sync)
+		return 0;
+
+	/* Already matching, e.g. when replaying controls at stream start */
+	if (imx307_gain_db_matches(imx307, ctrl->val))
+		return 0;
+
+	imx307_split_gain_db(ctrl->val, &again, &dgain);
+
+	imx307->gain_sync = true;
+	ret = __v4l2_ctrl_s_ctrl(imx307->again, again);
+	if (!ret)
+		ret = __v4l2_ctrl_s_ctrl(imx307->dgain, dgain);
+	imx307->gain_sync = false;
+
+	return ret;
+}
+
+/* Start a triggered capture, callable from any context */
+static int imx307_trigger(struct imx307 *imx307)
+{
+	if (!READ_ONCE(imx307->trigger_armed))
+		return -EBUSY;
+
+	/* Triggers during a capture are ignored */
+	if (atomic_cmpxchg(&imx307->trigger_busy, 0, 1))
+		return 0;
+
+	imx307->trigger_time = ktime_get();
+	kthread_queue_work(imx307->sched_worker, &imx307->trigger_work);
+
+	return 0;
+}
+
+/*
+ * Run the scheduler worker on every frame start while streaming with
+ * either deferred controls or a bracketing sequence.
+ */
+static void imx307_update_vsync(struct imx307 *imx307, bool streaming)
+{
+	bool enable = streaming &&
+		      (imx307->sched_active || imx307->bracket_len);
+
+	if (imx307->vsync_active == enable)
+		return;
+
+	WRITE_ONCE(imx307->vsync_active, enable);
+
+	if (enable) {
+		if (imx307->xvs_irq <= 0)
+			hrtimer_start(&imx307->vsync_timer,
+				      ns_to_ktime(imx307->frame_period_ns),
+				      HRTIMER_MODE_REL);
+	} else {
+		hrtimer_cancel(&imx307->vsync_timer);
+		kthread_cancel_work_sync(&imx307->sched_work);
+	}
+}
+
+/*
+ * Load a new bracketing sequence, or clear it. The register values of
+ * every frame are worked out here so that the scheduler worker only has to
+ * send them.
+ */
+static void imx307_set_bracket(struct imx307 *imx307, struct v4l2_ctrl *ctrl)
+{
+	struct imx307_bracket_frame bracket[imx307_BRACKET_MAX_FRAMES];
+	u32 vts_min = imx307->mode->height + imx307_VBLANK_MIN;
+	u32 vts_def = imx307_frame_length(imx307);
+	const u32 *entry = ctrl->p_new.p_u32;
+	struct imx307_bracket_frame *frame;
+	unsigned int len;
+	u32 gain_db;
+
+	for (len = 0; len < imx307_BRACKET_MAX_FRAMES; len++) {
+		if (!entry[imx307_BRACKET_EXPOSURE])
+			break;
+
+		frame = &bracket[len];
+
+		frame->vts = entry[imx307_BRACKET_VTS] ?
+			     clamp_t(u32, entry[imx307_BRACKET_VTS], vts_min,
+				     imx307_VTS_MAX) : vts_def;
+		frame->exposure = clamp_t(u32, entry[imx307_BRACKET_EXPOSURE],
+					  imx307_EXPOSURE_MIN, frame->vts - 4);
+
+		gain_db = min_t(u32, entry[imx307_BRACKET_GAIN_DB],
+				imx307_GAIN_DB_MAX);
+
+		imx307_split_gain_db(gain_db, &frame->again, &frame->dgain);
+
+		entry += imx307_BRACKET_NUM_FIELDS;
+	}
+
+	if (!len && !imx307->bracket_len)
+		return;
+
+	mutex_lock(&imx307->sched_lock);
+	memcpy(imx307->bracket, bracket, len * sizeof(*bracket));
+	imx307->bracket_len = len;
+	imx307->bracket_pos = 0;
+	mutex_unlock(&imx307->sched_lock);
+
+	/* The sequence writes these registers behind the cache's back */
+	imx307_invalidate_cache(imx307, imx307_REG_VTS, imx307_REG_VTS + 2);
+	imx307_invalidate_cache(imx307, imx307_REG_EXPOSURE,
+				imx307_REG_EXPOSURE + 2);
+	imx307_invalidate_cache(imx307, imx307_REG_ANALOG_GAIN,
+				imx307_REG_DIGITAL_GAIN + 2);
+
+	imx307_update_vsync(imx307, imx307->streaming);
+}
+
+/*
+ * Write the flips. While streaming they are applied inside a group hold,
+ * so the whole frame changes over at once, and subscribers are told from
+ * which frame on the new bayer order is in use.
+ */
+static int imx307_write_flips(struct imx307 *imx307)
+{
+	struct imx307_event_bayer_order *bayer_order;
+	struct v4l2_event event = {
+		.type = imx307_EVENT_BAYER_ORDER,
+	};
+	bool hold = imx307->streaming && !imx307->batching &&
+		    !imx307->sched_active;
+	u32 latency;
+	int ret;
+
+	if (hold) {
+		ret = imx307_hold_begin(imx307);
+		if (ret)
+			return ret;
+	}
+
+	ret = imx307_write_ctrl_reg(imx307, imx307_REG_ORIENTATION, 1,
+				    imx307->hflip->val |
+				    imx307->vflip->val << 1);
+
+	if (hold)
+		ret = imx307_hold_end(imx307, ret);
+
+	if (ret || !imx307->streaming || imx307->batching)
+		return ret;
+
+	/*
+	 * frame_sequence is that of the next frame. A hold released now
+	 * latches on its start, scheduled writes one frame later.
+	 */
+	latency = imx307->sched_active ? imx307_CTRL_LATENCY_FRAMES - 1 : 0;
+
+	bayer_order = (void *)event.u.data;
+	bayer_order->code = imx307_get_format_code(imx307, imx307->fmt.code);
+	bayer_order->frame_sequence = imx307->xvs_irq > 0 ?
+		READ_ONCE(imx307->frame_sequence) + latency : 0;
+	v4l2_event_queue(imx307->sd.devnode, &event);
 
 	return 0;
 }
@@ -729,17 +1781,38 @@ static int imx307_set_ctrl(struct v4l2_ctrl *ctrl)
 	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
 	int ret;
 
-	if (ctrl->id == V4L2_CID_VBLANK) {
-		int exposure_max, exposure_def;
-
+	switch (ctrl->id) {
+	case V4L2_CID_VBLANK:
+	case imx307_CID_AUTO_FRAME_LENGTH:
 		/* Update max exposure while meeting expected vblanking */
-		exposure_max = imx307->mode->height + ctrl->val - 4;
-		exposure_def = (exposure_max < imx307_EXPOSURE_DEFAULT) ?
-			exposure_max : imx307_EXPOSURE_DEFAULT;
-		__v4l2_ctrl_modify_range(imx307->exposure,
-					 imx307->exposure->minimum,
-					 exposure_max, imx307->exposure->step,
-					 exposure_def);
+		imx307_update_exposure_range(imx307,
+					     imx307_exposure_max(imx307));
+		break;
+	case V4L2_CID_EXPOSURE:
+		imx307_sync_exposure_time(imx307, NULL, ctrl->val);
+		break;
+	case V4L2_CID_EXPOSURE_ABSOLUTE:
+	case imx307_CID_EXPOSURE_US:
+		/* Only ever applied through V4L2_CID_EXPOSURE */
+		return imx307_set_exposure_time(imx307, ctrl);
+	case V4L2_CID_ANALOGUE_GAIN:
+	case V4L2_CID_DIGITAL_GAIN:
+		imx307_sync_gain_db(imx307);
+		break;
+	case imx307_CID_GAIN_DB:
+		/* Only ever applied through the analogue and digital gains */
+		return imx307_set_gain_db(imx307, ctrl);
+	case imx307_CID_BRACKET:
+		imx307_set_bracket(imx307, ctrl);
+		break;
+	case imx307_CID_TRIGGER_MODE:
+		/* Only takes effect at the next stream start */
+		return 0;
+	case imx307_CID_TRIGGER_FRAMES:
+		WRITE_ONCE(imx307->trigger_frames, ctrl->val);
+		return 0;
+	case imx307_CID_TRIGGER:
+		return imx307_trigger(imx307);
 	}
 
 	/*
@@ -751,48 +1824,67 @@ static int imx307_set_ctrl(struct v4l2_ctrl *ctrl)
 
 	switch (ctrl->id) {
 	case V4L2_CID_ANALOGUE_GAIN:
-		ret = imx307_write_reg(imx307, imx307_REG_ANALOG_GAIN,
-				       imx307_REG_VALUE_08BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_ANALOG_GAIN,
+					    imx307_REG_VALUE_08BIT, ctrl->val);
 		break;
 	case V4L2_CID_EXPOSURE:
-		ret = imx307_write_reg(imx307, imx307_REG_EXPOSURE,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		if (imx307->auto_frame_length->val)
+			ret = imx307_write_frame_timing(imx307);
+		else
+			ret = imx307_write_ctrl_reg(imx307, imx307_REG_EXPOSURE,
+						    imx307_REG_VALUE_16BIT,
+						    ctrl->val);
 		break;
 	case V4L2_CID_DIGITAL_GAIN:
-		ret = imx307_write_reg(imx307, imx307_REG_DIGITAL_GAIN,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_DIGITAL_GAIN,
+					    imx307_REG_VALUE_16BIT, ctrl->val);
 		break;
 	case V4L2_CID_TEST_PATTERN:
-		ret = imx307_write_reg(imx307, imx307_REG_TEST_PATTERN,
-				       imx307_REG_VALUE_16BIT,
-				       imx307_test_pattern_val[ctrl->val]);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_TEST_PATTERN,
+					    imx307_REG_VALUE_16BIT,
+					    imx307_test_pattern_val[ctrl->val]);
 		break;
 	case V4L2_CID_HFLIP:
 	case V4L2_CID_VFLIP:
-		ret = imx307_write_reg(imx307, imx307_REG_ORIENTATION, 1,
-				       imx307->hflip->val |
-				       imx307->vflip->val << 1);
+		ret = imx307_write_flips(imx307);
 		break;
 	case V4L2_CID_VBLANK:
-		ret = imx307_write_reg(imx307, imx307_REG_VTS,
-				       imx307_REG_VALUE_16BIT,
-				       imx307->mode->height + ctrl->val);
+	case imx307_CID_AUTO_FRAME_LENGTH:
+		ret = imx307_write_frame_timing(imx307);
+		break;
+	case imx307_CID_BRACKET:
+		/* Put back what the sequence overrode once it is cleared */
+		ret = 0;
+		if (imx307->bracket_len)
+			break;
+
+		ret = imx307_write_frame_timing(imx307);
+		if (!ret)
+			ret = imx307_write_ctrl_reg(imx307,
+						    imx307_REG_ANALOG_GAIN,
+						    imx307_REG_VALUE_08BIT,
+						    imx307->again->val);
+		if (!ret)
+			ret = imx307_write_ctrl_reg(imx307,
+						    imx307_REG_DIGITAL_GAIN,
+						    imx307_REG_VALUE_16BIT,
+						    imx307->dgain->val);
 		break;
 	case V4L2_CID_TEST_PATTERN_RED:
-		ret = imx307_write_reg(imx307, imx307_REG_TESTP_RED,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_TESTP_RED,
+					    imx307_REG_VALUE_16BIT, ctrl->val);
 		break;
 	case V4L2_CID_TEST_PATTERN_GREENR:
-		ret = imx307_write_reg(imx307, imx307_REG_TESTP_GREENR,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_TESTP_GREENR,
+					    imx307_REG_VALUE_16BIT, ctrl->val);
 		break;
 	case V4L2_CID_TEST_PATTERN_BLUE:
-		ret = imx307_write_reg(imx307, imx307_REG_TESTP_BLUE,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_TESTP_BLUE,
+					    imx307_REG_VALUE_16BIT, ctrl->val);
 		break;
 	case V4L2_CID_TEST_PATTERN_GREENB:
-		ret = imx307_write_reg(imx307, imx307_REG_TESTP_GREENB,
-				       imx307_REG_VALUE_16BIT, ctrl->val);
+		ret = imx307_write_ctrl_reg(imx307, imx307_REG_TESTP_GREENB,
+					    imx307_REG_VALUE_16BIT, ctrl->val);
 		break;
 	default:
 		dev_info(&client->dev,
@@ -807,10 +1899,122 @@ static int imx307_set_ctrl(struct v4l2_ctrl *ctrl)
 	return ret;
 }
 
+static int imx307_get_volatile_ctrl(struct v4l2_ctrl *ctrl)
+{
+	struct imx307 *imx307 =
+		container_of(ctrl->handler, struct imx307, ctrl_handler);
+
+	switch (ctrl->id) {
+	case imx307_CID_TRIGGER_LATENCY_US:
+		ctrl->val = READ_ONCE(imx307->trigger_latency_us);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static const struct v4l2_ctrl_ops imx307_ctrl_ops = {
+	.g_volatile_ctrl = imx307_get_volatile_ctrl,
 	.s_ctrl = imx307_set_ctrl,
 };
 
+static const struct v4l2_ctrl_config imx307_gain_db_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_GAIN_DB,
+	.name = "Gain, 0.1 dB",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = imx307_GAIN_DB_MAX,
+	.step = 1,
+	.def = 0,
+};
+
+/*
+ * With trigger mode set, starting the stream only arms the sensor. Each
+ * trigger, from the Trigger control or the optional trigger GPIO, then
+ * captures Trigger Frame Count frames before the sensor returns to standby.
+ */
+static const struct v4l2_ctrl_config imx307_trigger_mode_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_TRIGGER_MODE,
+	.name = "Trigger Mode",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min = 0,
+	.max = 1,
+	.step = 1,
+	.def = 0,
+};
+
+static const struct v4l2_ctrl_config imx307_trigger_frames_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_TRIGGER_FRAMES,
+	.name = "Trigger Frame Count",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 1,
+	.max = 255,
+	.step = 1,
+	.def = 1,
+};
+
+static const struct v4l2_ctrl_config imx307_trigger_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_TRIGGER,
+	.name = "Trigger",
+	.type = V4L2_CTRL_TYPE_BUTTON,
+};
+
+/* Time from the last trigger to the start of its first frame */
+static const struct v4l2_ctrl_config imx307_trigger_latency_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_TRIGGER_LATENCY_US,
+	.name = "Trigger Latency, Microseconds",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.min = 0,
+	.max = S32_MAX,
+	.step = 1,
+	.def = 0,
+	.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE,
+};
+
+/* See imx307_BRACKET_MAX_FRAMES */
+static const struct v4l2_ctrl_config imx307_bracket_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_BRACKET,
+	.name = "Exposure Bracketing",
+	.type = V4L2_CTRL_TYPE_U32,
+	.min = 0,
+	.max = U16_MAX,
+	.step = 1,
+	.def = 0,
+	.dims = { imx307_BRACKET_MAX_FRAMES, imx307_BRACKET_NUM_FIELDS },
+};
+
+/*
+ * When set, the frame length grows as needed to fit the exposure, and VBLANK
+ * only sets the minimum frame length.
+ */
+static const struct v4l2_ctrl_config imx307_auto_frame_length_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_AUTO_FRAME_LENGTH,
+	.name = "Auto Frame Length",
+	.type = V4L2_CTRL_TYPE_BOOLEAN,
+	.min = 0,
+	.max = 1,
+	.step = 1,
+	.def = 0,
+};
+
+/* Range set from the current mode in imx307_init_controls() */
+static const struct v4l2_ctrl_config imx307_exposure_us_ctrl = {
+	.ops = &imx307_ctrl_ops,
+	.id = imx307_CID_EXPOSURE_US,
+	.name = "Exposure Time, Microseconds",
+	.type = V4L2_CTRL_TYPE_INTEGER,
+	.step = 1,
+};
+
 static int imx307_enum_mbus_code(struct v4l2_subdev *sd,
 				 struct v4l2_subdev_pad_config *cfg,
 				 struct v4l2_subdev_mbus_code_enum *code)
@@ -846,15 +2050,15 @@ static int imx307_enum_frame_size(struct v4l2_subdev *sd,
 		return -EINVAL;
 
 	if (fse->pad == IMAGE_PAD) {
-		if (fse->index >= ARRAY_SIZE(supported_modes))
+		if (fse->index >= imx307->num_modes)
 			return -EINVAL;
 
 		if (fse->code != imx307_get_format_code(imx307, fse->code))
 			return -EINVAL;
 
-		fse->min_width = supported_modes[fse->index].width;
+		fse->min_width = imx307->modes[fse->index].width;
 		fse->max_width = fse->min_width;
-		fse->min_height = supported_modes[fse->index].height;
+		fse->min_height = imx307->modes[fse->index].height;
 		fse->max_height = fse->min_height;
 	} else {
 		if (fse->code != MEDIA_BUS_FMT_SENSOR_DATA || fse->index > 0)
@@ -940,6 +2144,323 @@ static int imx307_get_pad_format(struct v4l2_subdev *sd,
 	return ret;
 }
 
+static int imx307_get_framefmt(u32 code)
+{
+	switch (code) {
+	case MEDIA_BUS_FMT_SRGGB8_1X8:
+	case MEDIA_BUS_FMT_SGRBG8_1X8:
+	case MEDIA_BUS_FMT_SGBRG8_1X8:
+	case MEDIA_BUS_FMT_SBGGR8_1X8:
+		return imx307_FRAMEFMT_RAW8;
+
+	case MEDIA_BUS_FMT_SRGGB10_1X10:
+	case MEDIA_BUS_FMT_SGRBG10_1X10:
+	case MEDIA_BUS_FMT_SGBRG10_1X10:
+	case MEDIA_BUS_FMT_SBGGR10_1X10:
+		return imx307_FRAMEFMT_RAW10;
+	}
+
+	return -EINVAL;
+}
+
+/* Force the next stream start to reload the mode and frame format */
+static void imx307_invalidate_mode(struct imx307 *imx307)
+{
+	imx307->programmed_mode = NULL;
+	imx307->programmed_framefmt = -1;
+}
+
+/* Make a mode current, updating the limits of the controls it affects */
+static int imx307_set_mode(struct imx307 *imx307,
+			   const struct imx307_mode *mode,
+			   const struct v4l2_mbus_framefmt *format)
+{
+	int hblank, ret;
+
+	imx307->fmt = *format;
+	imx307->mode = mode;
+	/* Update limits and set FPS to default */
+	__v4l2_ctrl_modify_range(imx307->vblank, imx307_VBLANK_MIN,
+				 imx307_VTS_MAX - mode->height, 1,
+				 mode->vts_def - mode->height);
+	ret = __v4l2_ctrl_s_ctrl(imx307->vblank, mode->vts_def - mode->height);
+	/* Update max exposure while meeting expected vblanking */
+	imx307_update_exposure_range(imx307, imx307_exposure_max(imx307));
+	/*
+	 * Currently PPL is fixed to imx307_PPL_DEFAULT, so hblank depends on
+	 * mode->width only, and is not changeble in any way other than
+	 * changing the mode.
+	 */
+	hblank = imx307_PPL_DEFAULT - mode->width;
+	__v4l2_ctrl_modify_range(imx307->hblank, hblank, hblank, 1, hblank);
+
+	return ret;
+}
+
+/*
+ * Registers that may differ between two modes for the switch between them
+ * to be made while streaming: analog crop, output size, readout increments
+ * and binning, and the test pattern window.
+ */
+static const struct imx307_reg_range {
+	u16 start;
+	u16 end;
+} imx307_seamless_ranges[] = {
+	{ 0x0164, 0x0175 },
+	{ 0x0624, 0x0627 },
+};
+
+static bool imx307_reg_is_seamless(u16 reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(imx307_seamless_ranges); i++)
+		if (reg >= imx307_seamless_ranges[i].start &&
+		    reg <= imx307_seamless_ranges[i].end)
+			return true;
+
+	return false;
+}
+
+/* Value a burst list leaves in a register, or -1 if it is not written */
+static int imx307_burst_reg_val(const struct imx307_burst_list *list, u16 reg)
+{
+	unsigned int pos, n;
+	int val = -1;
+	u16 start;
+
+	for (pos = 0; pos < list->len; pos += n + 3) {
+		n = list->data[pos];
+		start = get_unaligned_be16(&list->data[pos + 1]);
+		if (reg >= start && reg < start + n)
+			val = list->data[pos + 3 + reg - start];
+	}
+
+	return val;
+}
+
+/*
+ * Compare the register state two mode tables leave behind. With queue set,
+ * the writes turning one into the other are queued. Returns -EBUSY if the
+ * tables differ outside imx307_seamless_ranges or write different sets
+ * of registers.
+ */
+static int imx307_mode_delta(struct imx307 *imx307,
+			     const struct imx307_burst_list *from,
+			     const struct imx307_burst_list *to, bool queue)
+{
+	unsigned int pos, n, i;
+	int old, new, ret;
+	u16 start, reg;
+
+	for (pos = 0; pos < from->len; pos += n + 3) {
+		n = from->data[pos];
+		start = get_unaligned_be16(&from->data[pos + 1]);
+		for (i = 0; i < n; i++)
+			if (imx307_burst_reg_val(to, start + i) < 0)
+				return -EBUSY;
+	}
+
+	for (pos = 0; pos < to->len; pos += n + 3) {
+		n = to->data[pos];
+		start = get_unaligned_be16(&to->data[pos + 1]);
+		for (i = 0; i < n; i++) {
+			reg = start + i;
+			old = imx307_burst_reg_val(from, reg);
+			new = imx307_burst_reg_val(to, reg);
+			if (old < 0)
+				return -EBUSY;
+			if (old == new)
+				continue;
+			if (!imx307_reg_is_seamless(reg))
+				return -EBUSY;
+			if (!queue)
+				continue;
+
+			ret = __imx307_queue_reg(imx307, &imx307->queue, reg,
+						 imx307_REG_VALUE_08BIT, new,
+						 true);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Switch mode while streaming. Only the registers that differ from the
+ * programmed mode are written, together with the new frame timing, in a
+ * single transfer inside a group hold, so the sensor changes over on the
+ * next frame boundary. Modes needing anything more than that, or a
+ * different bit depth, still require the stream to be stopped. On failure
+ * the previous mode and format stay current.
+ */
+static int imx307_switch_mode(struct imx307 *imx307,
+			      const struct imx307_mode *mode,
+			      const struct v4l2_mbus_framefmt *format)
+{
+	struct v4l2_event event = {
+		.type = V4L2_EVENT_SOURCE_CHANGE,
+		.u.src_change.changes = V4L2_EVENT_SRC_CH_RESOLUTION,
+	};
+	const struct imx307_mode *old_mode = imx307->mode;
+	struct v4l2_mbus_framefmt old_fmt = imx307->fmt;
+	s32 vblank = imx307->vblank->val;
+	s32 exposure = imx307->exposure->val;
+	int ret;
+
+	if (imx307->programmed_mode != imx307->mode ||
+	    imx307_get_framefmt(format->code) != imx307->programmed_framefmt)
+		return -EBUSY;
+
+	ret = imx307_mode_delta(imx307, &imx307->mode->bursts, &mode->bursts,
+				false);
+	if (ret)
+		return ret;
+
+	ret = imx307_hold_begin(imx307);
+	if (ret)
+		return ret;
+
+	ret = imx307_mode_delta(imx307, &imx307->mode->bursts, &mode->bursts,
+				true);
+	if (ret)
+		return imx307_hold_end(imx307, ret);
+
+	/* Frame length and exposure writes join the same transfer */
+	ret = imx307_set_mode(imx307, mode, format);
+	if (!ret)
+		ret = imx307_write_frame_timing(imx307);
+
+	ret = imx307_hold_end(imx307, ret);
+	if (ret) {
+		/*
+		 * Part of the switch may have reached the sensor, so have the
+		 * next stream start reload it. Put back the previous mode and
+		 * timing without touching the sensor: while batching, the
+		 * control handlers only queue their writes, which are then
+		 * dropped.
+		 */
+		imx307_invalidate_mode(imx307);
+		imx307->batching = true;
+		imx307_set_mode(imx307, old_mode, &old_fmt);
+		__v4l2_ctrl_s_ctrl(imx307->vblank, vblank);
+		__v4l2_ctrl_s_ctrl(imx307->exposure, exposure);
+		imx307->batching = false;
+		imx307_discard_queue(imx307, &imx307->queue);
+		return ret;
+	}
+
+	imx307->programmed_mode = mode;
+
+	v4l2_event_queue(imx307->sd.devnode, &event);
+
+	return 0;
+}
+
+static int imx307_set_framefmt(struct imx307 *imx307)
+{
+	int framefmt = imx307_get_framefmt(imx307->fmt.code);
+
+	if (framefmt < 0)
+		return framefmt;
+
+	return imx307_write_bursts(imx307, &imx307->framefmt_bursts[framefmt]);
+}
+
+/* Program the current mode, format and controls, leaving it in standby */
+static int imx307_program_sensor(struct imx307 *imx307)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	int framefmt = imx307_get_framefmt(imx307->fmt.code);
+	bool delta = false;
+	int ret;
+
+	/*
+	 * The tables only need writing if the sensor lost power or a
+	 * different mode or bit depth was selected since the last time it
+	 * was programmed. Coming from another mode at the same bit depth,
+	 * writing the registers that differ is usually enough.
+	 */
+	if (imx307->programmed_mode != imx307->mode &&
+	    imx307->programmed_mode &&
+	    imx307->programmed_framefmt == framefmt)
+		delta = !imx307_mode_delta(imx307,
+					   &imx307->programmed_mode->bursts,
+					   &imx307->mode->bursts, false);
+
+	if (!delta && (imx307->programmed_mode != imx307->mode ||
+		       imx307->programmed_framefmt != framefmt)) {
+		imx307_invalidate_mode(imx307);
+
+		/* Apply default values of current mode */
+		ret = imx307_write_bursts(imx307, &imx307->mode->bursts);
+		if (ret) {
+			dev_err(&client->dev, "%s failed to set mode\n",
+				__func__);
+			return ret;
+		}
+
+		ret = imx307_set_framefmt(imx307);
+		if (ret) {
+			dev_err(&client->dev,
+				"%s failed to set frame format: %d\n",
+				__func__, ret);
+			return ret;
+		}
+
+		imx307->programmed_mode = imx307->mode;
+		imx307->programmed_framefmt = framefmt;
+	}
+
+	/* Apply customized values from user, as a single transfer */
+	imx307->batching = true;
+	ret = 0;
+	if (delta)
+		ret = imx307_mode_delta(imx307,
+					&imx307->programmed_mode->bursts,
+					&imx307->mode->bursts, true);
+	if (!ret)
+		ret = __v4l2_ctrl_handler_setup(imx307->sd.ctrl_handler);
+	imx307->batching = false;
+	if (ret)
+		imx307_discard_queue(imx307, &imx307->queue);
+	else
+		ret = imx307_flush_queue(imx307, &imx307->queue);
+
+	if (ret) {
+		/* Part of the difference may have been written */
+		if (delta)
+			imx307_invalidate_mode(imx307);
+		return ret;
+	}
+
+	imx307->programmed_mode = imx307->mode;
+
+	return 0;
+}
+
+/*
+ * Program a newly selected mode straight away if the sensor is powered
+ * anyway, taking the table writes off the stream start path.
+ */
+static void imx307_preprogram(struct imx307 *imx307)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	int ret;
+
+	if (pm_runtime_get_if_active(&client->dev, true) <= 0)
+		return;
+
+	ret = imx307_program_sensor(imx307);
+	if (ret)
+		dev_dbg(&client->dev, "%s failed: %d\n", __func__, ret);
+
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+}
+
 static int imx307_set_pad_format(struct v4l2_subdev *sd,
 				 struct v4l2_subdev_pad_config *cfg,
 				 struct v4l2_subdev_format *fmt)
@@ -947,8 +2468,8 @@ static int imx307_set_pad_format(struct v4l2_subdev *sd,
 	struct imx307 *imx307 = to_imx307(sd);
 	const struct imx307_mode *mode;
 	struct v4l2_mbus_framefmt *framefmt;
-	int exposure_max, exposure_def, hblank;
 	unsigned int i;
+	int ret = 0;
 
 	if (fmt->pad >= NUM_PADS)
 		return -EINVAL;
@@ -965,8 +2486,8 @@ static int imx307_set_pad_format(struct v4l2_subdev *sd,
 		/* Bayer order varies with flips */
 		fmt->format.code = imx307_get_format_code(imx307, codes[i]);
 
-		mode = v4l2_find_nearest_size(supported_modes,
-					      ARRAY_SIZE(supported_modes),
+		mode = v4l2_find_nearest_size(imx307->modes,
+					      imx307->num_modes,
 					      width, height,
 					      fmt->format.width,
 					      fmt->format.height);
@@ -977,37 +2498,13 @@ static int imx307_set_pad_format(struct v4l2_subdev *sd,
 			*framefmt = fmt->format;
 		} else if (imx307->mode != mode ||
 			imx307->fmt.code != fmt->format.code) {
-			imx307->fmt = fmt->format;
-			imx307->mode = mode;
-			/* Update limits and set FPS to default */
-			__v4l2_ctrl_modify_range(imx307->vblank,
-						 imx307_VBLANK_MIN,
-						 imx307_VTS_MAX - mode->height,
-						 1,
-						 mode->vts_def - mode->height);
-			__v4l2_ctrl_s_ctrl(imx307->vblank,
-					   mode->vts_def - mode->height);
-			/*
-			 * Update max exposure while meeting
-			 * expected vblanking
-			 */
-			exposure_max = mode->vts_def - 4;
-			exposure_def =
-				(exposure_max < imx307_EXPOSURE_DEFAULT) ?
-					exposure_max : imx307_EXPOSURE_DEFAULT;
-			__v4l2_ctrl_modify_range(imx307->exposure,
-						 imx307->exposure->minimum,
-						 exposure_max,
-						 imx307->exposure->step,
-						 exposure_def);
-			/*
-			 * Currently PPL is fixed to imx307_PPL_DEFAULT, so
-			 * hblank depends on mode->width only, and is not
-			 * changeble in any way other than changing the mode.
-			 */
-			hblank = imx307_PPL_DEFAULT - mode->width;
-			__v4l2_ctrl_modify_range(imx307->hblank, hblank, hblank,
-						 1, hblank);
+			if (imx307->streaming)
+				ret = imx307_switch_mode(imx307, mode,
+							 &fmt->format);
+			else {
+				imx307_set_mode(imx307, mode, &fmt->format);
+				imx307_preprogram(imx307);
+			}
 		}
 	} else {
 		if (fmt->which == V4L2_SUBDEV_FORMAT_TRY) {
@@ -1022,28 +2519,7 @@ static int imx307_set_pad_format(struct v4l2_subdev *sd,
 
 	mutex_unlock(&imx307->mutex);
 
-	return 0;
-}
-
-static int imx307_set_framefmt(struct imx307 *imx307)
-{
-	switch (imx307->fmt.code) {
-	case MEDIA_BUS_FMT_SRGGB8_1X8:
-	case MEDIA_BUS_FMT_SGRBG8_1X8:
-	case MEDIA_BUS_FMT_SGBRG8_1X8:
-	case MEDIA_BUS_FMT_SBGGR8_1X8:
-		return imx307_write_regs(imx307, raw8_framefmt_regs,
-					ARRAY_SIZE(raw8_framefmt_regs));
-
-	case MEDIA_BUS_FMT_SRGGB10_1X10:
-	case MEDIA_BUS_FMT_SGRBG10_1X10:
-	case MEDIA_BUS_FMT_SGBRG10_1X10:
-	case MEDIA_BUS_FMT_SBGGR10_1X10:
-		return imx307_write_regs(imx307, raw10_framefmt_regs,
-					ARRAY_SIZE(raw10_framefmt_regs));
-	}
-
-	return -EINVAL;
+	return ret;
 }
 
 static const struct v4l2_rect *
@@ -1097,10 +2573,191 @@ static int imx307_get_selection(struct v4l2_subdev *sd,
 	return -EINVAL;
 }
 
+static void imx307_start_watchdog(struct imx307 *imx307)
+{
+	if (!watchdog_ms)
+		return;
+
+	/* Force the first sample to be taken as the reference count */
+	imx307->watchdog_frame_count = U32_MAX;
+	schedule_delayed_work(&imx307->watchdog_work,
+			      msecs_to_jiffies(watchdog_ms));
+}
+
+/*
+ * XVS marks the start of each frame. The event is queued, and therefore
+ * timestamped, from the hard interrupt handler.
+ */
+static irqreturn_t imx307_xvs_irq(int irq, void *data)
+{
+	struct imx307 *imx307 = data;
+	struct v4l2_event event = {
+		.type = V4L2_EVENT_FRAME_SYNC,
+	};
+
+	imx307->xvs_time = ktime_get();
+	event.u.frame_sync.frame_sequence = imx307->frame_sequence++;
+	v4l2_event_queue(imx307->sd.devnode, &event);
+
+	if (atomic_read(&imx307->trigger_busy)) {
+		int left = atomic_dec_return(&imx307->trigger_frames_left);
+
+		if (left == imx307->trigger_count - 1)
+			WRITE_ONCE(imx307->trigger_latency_us,
+				   ktime_us_delta(imx307->xvs_time,
+						  imx307->trigger_time));
+
+		/* Standby takes effect at the end of the frame in progress */
+		if (!left)
+			kthread_queue_work(imx307->sched_worker,
+					   &imx307->trigger_stop_work);
+	}
+
+	if (READ_ONCE(imx307->vsync_active))
+		kthread_queue_work(imx307->sched_worker, &imx307->sched_work);
+
+	return IRQ_HANDLED;
+}
+
+static enum hrtimer_restart imx307_vsync_timer(struct hrtimer *timer)
+{
+	struct imx307 *imx307 = container_of(timer, struct imx307,
+					     vsync_timer);
+
+	kthread_queue_work(imx307->sched_worker, &imx307->sched_work);
+	hrtimer_forward_now(timer,
+			    ns_to_ktime(READ_ONCE(imx307->frame_period_ns)));
+
+	return HRTIMER_RESTART;
+}
+
+static irqreturn_t imx307_trigger_irq(int irq, void *data)
+{
+	imx307_trigger(data);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Leave standby for a triggered capture. Runs on the real-time scheduler
+ * worker, which keeps the trigger to first frame latency low and steady.
+ */
+static void imx307_trigger_work(struct kthread_work *work)
+{
+	struct imx307 *imx307 = container_of(work, struct imx307,
+					     trigger_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	u32 frames = READ_ONCE(imx307->trigger_frames);
+	int ret;
+
+	imx307->trigger_count = frames;
+	atomic_set(&imx307->trigger_frames_left, frames);
+
+	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+			       imx307_REG_VALUE_08BIT, imx307_MODE_STREAMING);
+	if (ret) {
+		dev_err_ratelimited(&client->dev,
+				    "failed to start triggered capture: %d\n",
+				    ret);
+		atomic_set(&imx307->trigger_busy, 0);
+	}
+}
+
+static void imx307_trigger_stop_work(struct kthread_work *work)
+{
+	struct imx307 *imx307 = container_of(work, struct imx307,
+					     trigger_stop_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	int ret;
+
+	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+			       imx307_REG_VALUE_08BIT, imx307_MODE_STANDBY);
+	if (ret)
+		dev_err_ratelimited(&client->dev,
+				    "failed to end triggered capture: %d\n",
+				    ret);
+
+	atomic_set(&imx307->trigger_busy, 0);
+}
+
+static void imx307_arm_trigger(struct imx307 *imx307)
+{
+	atomic_set(&imx307->trigger_busy, 0);
+	WRITE_ONCE(imx307->trigger_armed, true);
+}
+
+static void imx307_disarm_trigger(struct imx307 *imx307)
+{
+	if (!imx307->trigger_armed)
+		return;
+
+	WRITE_ONCE(imx307->trigger_armed, false);
+
+	kthread_cancel_work_sync(&imx307->trigger_work);
+	kthread_cancel_work_sync(&imx307->trigger_stop_work);
+	atomic_set(&imx307->trigger_busy, 0);
+}
+
+static void imx307_sched_work(struct kthread_work *work)
+{
+	struct imx307 *imx307 = container_of(work, struct imx307, sched_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	u32 vts;
+	int ret = 0;
+
+	mutex_lock(&imx307->sched_lock);
+
+	if (imx307->bracket_len) {
+		vts = imx307->bracket[imx307->bracket_pos].vts;
+		ret = imx307_sched_bracket(imx307);
+
+		/* Follow the bracketed frame lengths, roughly */
+		WRITE_ONCE(imx307->frame_period_ns,
+			   (u64)vts * imx307_line_time_ns(imx307));
+	}
+
+	if (!ret)
+		ret = __imx307_sched_flush(imx307);
+
+	mutex_unlock(&imx307->sched_lock);
+
+	if (ret)
+		dev_err_ratelimited(&client->dev,
+				    "failed to apply controls: %d\n", ret);
+}
+
+static void imx307_start_sched(struct imx307 *imx307)
+{
+	imx307->sched_active = frame_sync_ctrls;
+	imx307_update_vsync(imx307, true);
+}
+
+/* Stop the scheduler, sending anything still pending straight away */
+static void imx307_stop_sched(struct imx307 *imx307)
+{
+	imx307->sched_active = false;
+	imx307_update_vsync(imx307, false);
+	imx307_sched_flush(imx307);
+}
+
+static void imx307_enable_xvs(struct imx307 *imx307, bool enable)
+{
+	if (imx307->xvs_irq <= 0 || imx307->xvs_enabled == enable)
+		return;
+
+	if (enable) {
+		imx307->frame_sequence = 0;
+		enable_irq(imx307->xvs_irq);
+	} else {
+		disable_irq(imx307->xvs_irq);
+	}
+
+	imx307->xvs_enabled = enable;
+}
+
 static int imx307_start_streaming(struct imx307 *imx307)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
-	const struct imx307_reg_list *reg_list;
 	int ret;
 
 	ret = pm_runtime_get_sync(&client->dev);
@@ -1109,38 +2766,37 @@ static int imx307_start_streaming(struct imx307 *imx307)
 		return ret;
 	}
 
-	/* Apply default values of current mode */
-	reg_list = &imx307->mode->reg_list;
-	ret = imx307_write_regs(imx307, reg_list->regs, reg_list->num_of_regs);
-	if (ret) {
-		dev_err(&client->dev, "%s failed to set mode\n", __func__);
+	ret = imx307_program_sensor(imx307);
+	if (ret)
 		goto err_rpm_put;
-	}
 
-	ret = imx307_set_framefmt(imx307);
-	if (ret) {
-		dev_err(&client->dev, "%s failed to set frame format: %d\n",
-			__func__, ret);
-		goto err_rpm_put;
+	/* Count frames from the first one */
+	imx307_enable_xvs(imx307, true);
+
+	if (imx307->trigger_mode && imx307->trigger_mode->val) {
+		/* Stay programmed in standby until triggered */
+		imx307_arm_trigger(imx307);
+	} else {
+		/* set stream on register */
+		ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+				       imx307_REG_VALUE_08BIT,
+				       imx307_MODE_STREAMING);
+		if (ret)
+			goto err_xvs_disable;
 	}
 
-	/* Apply customized values from user */
-	ret =  __v4l2_ctrl_handler_setup(imx307->sd.ctrl_handler);
-	if (ret)
-		goto err_rpm_put;
+	__v4l2_ctrl_grab(imx307->trigger_mode, true);
 
-	/* set stream on register */
-	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
-			       imx307_REG_VALUE_08BIT, imx307_MODE_STREAMING);
-	if (ret)
-		goto err_rpm_put;
+	imx307_start_sched(imx307);
 
-	/* vflip and hflip cannot change during streaming */
-	__v4l2_ctrl_grab(imx307->vflip, true);
-	__v4l2_ctrl_grab(imx307->hflip, true);
+	/* An armed sensor legitimately produces no frames */
+	if (!imx307->trigger_armed)
+		imx307_start_watchdog(imx307);
 
 	return 0;
 
+err_xvs_disable:
+	imx307_enable_xvs(imx307, false);
 err_rpm_put:
 	pm_runtime_put(&client->dev);
 	return ret;
@@ -1151,16 +2807,86 @@ static void imx307_stop_streaming(struct imx307 *imx307)
 	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
 	int ret;
 
+	/*
+	 * Under the mutex the work cannot be waited for, but it bails out
+	 * once streaming is cleared. Callers that keep streaming set must
+	 * cancel it synchronously first.
+	 */
+	cancel_delayed_work(&imx307->watchdog_work);
+
+	imx307_stop_sched(imx307);
+	imx307_disarm_trigger(imx307);
+
 	/* set stream off register */
 	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
 			       imx307_REG_VALUE_08BIT, imx307_MODE_STANDBY);
 	if (ret)
 		dev_err(&client->dev, "%s failed to set stream\n", __func__);
 
-	__v4l2_ctrl_grab(imx307->vflip, false);
-	__v4l2_ctrl_grab(imx307->hflip, false);
+	imx307_enable_xvs(imx307, false);
 
-	pm_runtime_put(&client->dev);
+	__v4l2_ctrl_grab(imx307->trigger_mode, false);
+
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+}
+
+/*
+ * Recover a stalled sensor in place: drop to standby, reprogram the mode
+ * and the cached control values, and restart streaming. The sensor stays
+ * powered, so this avoids the full power cycle of a stream restart.
+ */
+static void imx307_watchdog_work(struct work_struct *work)
+{
+	struct imx307 *imx307 = container_of(to_delayed_work(work),
+					     struct imx307, watchdog_work);
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct v4l2_event event = {
+		.type = imx307_EVENT_WATCHDOG_RECOVERY,
+	};
+	u32 frame_count;
+	int ret;
+
+	mutex_lock(&imx307->mutex);
+
+	if (!imx307->streaming || !watchdog_ms)
+		goto unlock;
+
+	ret = imx307_read_reg(imx307, imx307_REG_FRAME_COUNT,
+			      imx307_REG_VALUE_08BIT, &frame_count);
+	if (!ret && frame_count != imx307->watchdog_frame_count) {
+		imx307->watchdog_frame_count = frame_count;
+		goto reschedule;
+	}
+
+	dev_warn(&client->dev, "sensor stalled, restarting stream\n");
+
+	/* The sensor may have lost its registers, replay all of them */
+	imx307_invalidate_mode(imx307);
+	imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
+
+	imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+			 imx307_REG_VALUE_08BIT, imx307_MODE_STANDBY);
+
+	ret = imx307_program_sensor(imx307);
+	if (!ret)
+		ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+				       imx307_REG_VALUE_08BIT,
+				       imx307_MODE_STREAMING);
+	if (ret) {
+		dev_err(&client->dev, "%s failed to restart stream: %d\n",
+			__func__, ret);
+		goto reschedule;
+	}
+
+	imx307->watchdog_frame_count = U32_MAX;
+	v4l2_event_queue(imx307->sd.devnode, &event);
+
+reschedule:
+	schedule_delayed_work(&imx307->watchdog_work,
+			      msecs_to_jiffies(watchdog_ms));
+unlock:
+	mutex_unlock(&imx307->mutex);
 }
 
 static int imx307_set_stream(struct v4l2_subdev *sd, int enable)
@@ -1199,7 +2925,12 @@ err_unlock:
 }
 
 /* Power/clock management functions */
-static int imx307_power_on(struct device *dev)
+
+/*
+ * Enable supplies and clock and release XCLR, without waiting for the
+ * sensor to become ready. See imx307_wait_xclr().
+ */
+static int __imx307_power_on(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
@@ -1222,8 +2953,11 @@ static int imx307_power_on(struct device *dev)
 	}
 
 	gpiod_set_value_cansleep(imx307->reset_gpio, 1);
-	usleep_range(imx307_XCLR_MIN_DELAY_US,
-		     imx307_XCLR_MIN_DELAY_US + imx307_XCLR_DELAY_RANGE_US);
+	imx307->xclr_time = ktime_get();
+
+	/* Registers are back at their reset values */
+	imx307_invalidate_mode(imx307);
+	imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
 
 	return 0;
 
@@ -1233,6 +2967,35 @@ reg_off:
 	return ret;
 }
 
+/* Sleep for whatever is left of the XCLR delay since the sensor powered up */
+static void imx307_wait_xclr(struct imx307 *imx307)
+{
+	s64 elapsed_us = ktime_us_delta(ktime_get(), imx307->xclr_time);
+
+	if (elapsed_us >= imx307_XCLR_MIN_DELAY_US)
+		return;
+
+	usleep_range(imx307_XCLR_MIN_DELAY_US - elapsed_us,
+		     imx307_XCLR_MIN_DELAY_US + imx307_XCLR_DELAY_RANGE_US -
+		     elapsed_us);
+}
+
+static int imx307_power_on(struct device *dev)
+{
+	struct i2c_client *client = to_i2c_client(dev);
+	struct v4l2_subdev *sd = i2c_get_clientdata(client);
+	struct imx307 *imx307 = to_imx307(sd);
+	int ret;
+
+	ret = __imx307_power_on(dev);
+	if (ret)
+		return ret;
+
+	imx307_wait_xclr(imx307);
+
+	return 0;
+}
+
 static int imx307_power_off(struct device *dev)
 {
 	struct i2c_client *client = to_i2c_client(dev);
@@ -1252,9 +3015,16 @@ static int __maybe_unused imx307_suspend(struct device *dev)
 	struct v4l2_subdev *sd = i2c_get_clientdata(client);
 	struct imx307 *imx307 = to_imx307(sd);
 
+	/* streaming stays set across suspend, so the work would not stop */
+	cancel_delayed_work_sync(&imx307->watchdog_work);
+
 	if (imx307->streaming)
 		imx307_stop_streaming(imx307);
 
+	/* Supplies may be cut while the system sleeps */
+	imx307_invalidate_mode(imx307);
+	imx307_invalidate_cache(imx307, 0, U16_MAX + 1);
+
 	return 0;
 }
 
@@ -1293,6 +3063,187 @@ static int imx307_get_regulators(struct imx307 *imx307)
 				       imx307->supplies);
 }
 
+/*
+ * Pack a firmware register table into burst segments, merging writes to
+ * consecutive addresses. The result lives as long as the device.
+ */
+static int imx307_compile_bursts(struct device *dev,
+				 const struct imx307_fw_reg *regs,
+				 unsigned int num_regs,
+				 struct imx307_burst_list *list)
+{
+	unsigned int i, pos = 0;
+	u8 *data, *seg = NULL;
+	u16 next_addr = 0;
+
+	/* Worst case is one 3 byte header per register */
+	data = devm_kmalloc(dev, num_regs * 4, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	for (i = 0; i < num_regs; i++) {
+		u16 addr = le16_to_cpu(regs[i].address);
+
+		if (!seg || addr != next_addr || *seg == imx307_BURST_MAX_LEN) {
+			seg = &data[pos];
+			*seg = 0;
+			put_unaligned_be16(addr, &data[pos + 1]);
+			pos += 3;
+		}
+
+		data[pos++] = regs[i].val;
+		(*seg)++;
+		next_addr = addr + 1;
+	}
+
+	list->data = data;
+	list->len = pos;
+
+	return 0;
+}
+
+static int imx307_parse_fw_mode(const struct imx307_fw_table *table,
+				struct imx307_mode *mode)
+{
+	mode->width = le16_to_cpu(table->width);
+	mode->height = le16_to_cpu(table->height);
+	mode->crop.left = le16_to_cpu(table->crop_left);
+	mode->crop.top = le16_to_cpu(table->crop_top);
+	mode->crop.width = le16_to_cpu(table->crop_width);
+	mode->crop.height = le16_to_cpu(table->crop_height);
+	mode->vts_def = le16_to_cpu(table->vts_def);
+
+	if (!mode->width || !mode->height ||
+	    mode->width > mode->crop.width ||
+	    mode->height > mode->crop.height ||
+	    mode->crop.left < imx307_PIXEL_ARRAY_LEFT ||
+	    mode->crop.top < imx307_PIXEL_ARRAY_TOP ||
+	    mode->crop.left + mode->crop.width >
+	    imx307_PIXEL_ARRAY_LEFT + imx307_PIXEL_ARRAY_WIDTH ||
+	    mode->crop.top + mode->crop.height >
+	    imx307_PIXEL_ARRAY_TOP + imx307_PIXEL_ARRAY_HEIGHT ||
+	    mode->vts_def < mode->height + imx307_VBLANK_MIN ||
+	    mode->vts_def > imx307_VTS_MAX)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Load mode and frame format tables from firmware. Nothing is changed
+ * unless the whole file validates, so the built-in tables remain in use
+ * on any error.
+ */
+static int imx307_load_firmware(struct imx307 *imx307, const char *name)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct device *dev = &client->dev;
+	struct imx307_burst_list framefmt[imx307_NUM_FRAMEFMTS] = { };
+	const struct imx307_fw_header *hdr;
+	const struct imx307_fw_table *table;
+	const struct firmware *fw;
+	struct imx307_mode *modes;
+	unsigned int num_modes = 0;
+	size_t pos, size;
+	unsigned int i;
+	int ret;
+
+	ret = firmware_request_nowarn(&fw, name, dev);
+	if (ret)
+		return ret;
+
+	ret = -EINVAL;
+	hdr = (const struct imx307_fw_header *)fw->data;
+	if (fw->size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != imx307_FW_MAGIC ||
+	    le16_to_cpu(hdr->version) != imx307_FW_VERSION) {
+		dev_err(dev, "%s: bad firmware header\n", name);
+		goto out;
+	}
+
+	size = le32_to_cpu(hdr->size);
+	if (size != fw->size - sizeof(*hdr) ||
+	    (crc32_le(~0, fw->data + sizeof(*hdr), size) ^ ~0) !=
+	    le32_to_cpu(hdr->crc)) {
+		dev_err(dev, "%s: bad firmware size or checksum\n", name);
+		goto out;
+	}
+
+	modes = devm_kcalloc(dev, imx307_FW_MAX_MODES, sizeof(*modes),
+			     GFP_KERNEL);
+	if (!modes) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	pos = sizeof(*hdr);
+	for (i = 0; i < le16_to_cpu(hdr->num_tables); i++) {
+		struct imx307_burst_list *list;
+		unsigned int num_regs;
+
+		table = (const struct imx307_fw_table *)(fw->data + pos);
+		if (fw->size - pos < sizeof(*table))
+			goto bad_table;
+
+		num_regs = le16_to_cpu(table->num_regs);
+		if (!num_regs ||
+		    fw->size - pos - sizeof(*table) <
+		    num_regs * sizeof(table->regs[0]))
+			goto bad_table;
+
+		switch (table->type) {
+		case imx307_FW_TABLE_MODE:
+			if (num_modes == imx307_FW_MAX_MODES ||
+			    imx307_parse_fw_mode(table, &modes[num_modes]))
+				goto bad_table;
+			list = &modes[num_modes++].bursts;
+			break;
+		case imx307_FW_TABLE_FRAMEFMT:
+			if (table->bit_depth == 8)
+				list = &framefmt[imx307_FRAMEFMT_RAW8];
+			else if (table->bit_depth == 10)
+				list = &framefmt[imx307_FRAMEFMT_RAW10];
+			else
+				goto bad_table;
+			break;
+		default:
+			goto bad_table;
+		}
+
+		ret = imx307_compile_bursts(dev, table->regs, num_regs, list);
+		if (ret)
+			goto out;
+
+		pos += sizeof(*table) + num_regs * sizeof(table->regs[0]);
+	}
+
+	if (pos != fw->size) {
+		dev_err(dev, "%s: trailing data in firmware\n", name);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (num_modes) {
+		imx307->modes = modes;
+		imx307->num_modes = num_modes;
+	}
+	for (i = 0; i < imx307_NUM_FRAMEFMTS; i++)
+		if (framefmt[i].len)
+			imx307->framefmt_bursts[i] = framefmt[i];
+
+	dev_info(dev, "%s: loaded %u modes\n", name, num_modes);
+	ret = 0;
+	goto out;
+
+bad_table:
+	dev_err(dev, "%s: invalid table %u\n", name, i);
+	ret = -EINVAL;
+out:
+	release_firmware(fw);
+
+	return ret;
+}
+
 /* Verify chip ID */
 static int imx307_identify_module(struct imx307 *imx307)
 {
@@ -1317,8 +3268,67 @@ static int imx307_identify_module(struct imx307 *imx307)
 	return 0;
 }
 
+static ssize_t i2c_retries_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct v4l2_subdev *sd = dev_get_drvdata(dev);
+	struct imx307 *imx307 = to_imx307(sd);
+
+	return sysfs_emit(buf, "%d\n", atomic_read(&imx307->i2c_retries));
+}
+static DEVICE_ATTR_RO(i2c_retries);
+
+static ssize_t i2c_recoveries_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct v4l2_subdev *sd = dev_get_drvdata(dev);
+	struct imx307 *imx307 = to_imx307(sd);
+
+	return sysfs_emit(buf, "%d\n", atomic_read(&imx307->i2c_recoveries));
+}
+static DEVICE_ATTR_RO(i2c_recoveries);
+
+static ssize_t i2c_failures_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct v4l2_subdev *sd = dev_get_drvdata(dev);
+	struct imx307 *imx307 = to_imx307(sd);
+
+	return sysfs_emit(buf, "%d\n", atomic_read(&imx307->i2c_failures));
+}
+static DEVICE_ATTR_RO(i2c_failures);
+
+static struct attribute *imx307_attrs[] = {
+	&dev_attr_i2c_retries.attr,
+	&dev_attr_i2c_recoveries.attr,
+	&dev_attr_i2c_failures.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(imx307);
+
+static int imx307_subscribe_event(struct v4l2_subdev *sd, struct v4l2_fh *fh,
+				  struct v4l2_event_subscription *sub)
+{
+	switch (sub->type) {
+	case imx307_EVENT_WATCHDOG_RECOVERY:
+		return v4l2_event_subscribe(fh, sub, 0, NULL);
+	case imx307_EVENT_BAYER_ORDER:
+		return v4l2_event_subscribe(fh, sub, imx307_FRAME_SYNC_EVENTS,
+					    NULL);
+	case V4L2_EVENT_SOURCE_CHANGE:
+		return v4l2_src_change_event_subdev_subscribe(sd, fh, sub);
+	case V4L2_EVENT_FRAME_SYNC:
+		if (to_imx307(sd)->xvs_irq <= 0)
+			return -EINVAL;
+		return v4l2_event_subscribe(fh, sub, imx307_FRAME_SYNC_EVENTS,
+					    NULL);
+	}
+
+	return v4l2_ctrl_subdev_subscribe_event(sd, fh, sub);
+}
+
 static const struct v4l2_subdev_core_ops imx307_core_ops = {
-	.subscribe_event = v4l2_ctrl_subdev_subscribe_event,
+	.subscribe_event = imx307_subscribe_event,
 	.unsubscribe_event = v4l2_event_subdev_unsubscribe,
 };
 
@@ -1326,12 +3336,35 @@ static const struct v4l2_subdev_video_ops imx307_video_ops = {
 	.s_stream = imx307_set_stream,
 };
 
+static int imx307_get_mbus_config(struct v4l2_subdev *sd, unsigned int pad,
+				  struct v4l2_mbus_config *config)
+{
+	struct imx307 *imx307 = to_imx307(sd);
+	unsigned int lanes = imx307->num_data_lanes;
+
+	if (pad != IMAGE_PAD)
+		return -EINVAL;
+
+	/* All modes use every lane of the endpoint */
+	config->type = V4L2_MBUS_CSI2_DPHY;
+	config->flags = (V4L2_MBUS_CSI2_1_LANE << (lanes - 1)) |
+			V4L2_MBUS_CSI2_CHANNEL_0;
+
+	if (imx307->csi2_flags & V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK)
+		config->flags |= V4L2_MBUS_CSI2_NONCONTINUOUS_CLOCK;
+	else
+		config->flags |= V4L2_MBUS_CSI2_CONTINUOUS_CLOCK;
+
+	return 0;
+}
+
 static const struct v4l2_subdev_pad_ops imx307_pad_ops = {
 	.enum_mbus_code = imx307_enum_mbus_code,
 	.get_fmt = imx307_get_pad_format,
 	.set_fmt = imx307_set_pad_format,
 	.get_selection = imx307_get_selection,
 	.enum_frame_size = imx307_enum_frame_size,
+	.get_mbus_config = imx307_get_mbus_config,
 };
 
 static const struct v4l2_subdev_ops imx307_subdev_ops = {
@@ -1340,8 +3373,117 @@ static const struct v4l2_subdev_ops imx307_subdev_ops = {
 	.pad = &imx307_pad_ops,
 };
 
+/* A file handle that took a runtime PM reference when it was opened */
+struct imx307_open_power {
+	struct list_head list;
+	struct v4l2_subdev_fh *fh;
+};
+
+/*
+ * Power the sensor up and program the current mode when the subdev is
+ * opened, so that a later STREAMON only has to start streaming. The
+ * reference belongs to @fh and is dropped again when it is closed.
+ */
+static void imx307_open_power_on(struct imx307 *imx307,
+				 struct v4l2_subdev_fh *fh)
+{
+	struct i2c_client *client = v4l2_get_subdevdata(&imx307->sd);
+	struct imx307_open_power *ref;
+	int ret;
+
+	/* Not fatal, imx307_start_streaming() will try again */
+	ref = kzalloc(sizeof(*ref), GFP_KERNEL);
+	if (!ref)
+		return;
+
+	ret = pm_runtime_get_sync(&client->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(&client->dev);
+		kfree(ref);
+		return;
+	}
+
+	mutex_lock(&imx307->mutex);
+
+	ref->fh = fh;
+	list_add(&ref->list, &imx307->open_power_fhs);
+
+	if (!imx307->streaming) {
+		ret = imx307_program_sensor(imx307);
+		if (ret)
+			dev_dbg(&client->dev, "%s failed: %d\n", __func__, ret);
+	}
+
+	mutex_unlock(&imx307->mutex);
+}
+
+static int imx307_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx307 *imx307 = to_imx307(sd);
+	struct v4l2_mbus_framefmt *try_fmt_img =
+		v4l2_subdev_get_try_format(sd, fh->pad, IMAGE_PAD);
+	struct v4l2_mbus_framefmt *try_fmt_meta =
+		v4l2_subdev_get_try_format(sd, fh->pad, METADATA_PAD);
+	struct v4l2_rect *try_crop;
+
+	mutex_lock(&imx307->mutex);
+
+	/* Initialize try_fmt for the image pad */
+	try_fmt_img->width = imx307->modes[0].width;
+	try_fmt_img->height = imx307->modes[0].height;
+	try_fmt_img->code = imx307_get_format_code(imx307,
+						   MEDIA_BUS_FMT_SRGGB10_1X10);
+	try_fmt_img->field = V4L2_FIELD_NONE;
+
+	/* Initialize try_fmt for the embedded metadata pad */
+	try_fmt_meta->width = imx307_EMBEDDED_LINE_WIDTH;
+	try_fmt_meta->height = imx307_NUM_EMBEDDED_LINES;
+	try_fmt_meta->code = MEDIA_BUS_FMT_SENSOR_DATA;
+	try_fmt_meta->field = V4L2_FIELD_NONE;
+
+	/* Initialize try_crop rectangle. */
+	try_crop = v4l2_subdev_get_try_crop(sd, fh->pad, 0);
+	try_crop->top = imx307_PIXEL_ARRAY_TOP;
+	try_crop->left = imx307_PIXEL_ARRAY_LEFT;
+	try_crop->width = imx307_PIXEL_ARRAY_WIDTH;
+	try_crop->height = imx307_PIXEL_ARRAY_HEIGHT;
+
+	mutex_unlock(&imx307->mutex);
+
+	if (power_on_open)
+		imx307_open_power_on(imx307, fh);
+
+	return 0;
+}
+
+static int imx307_close(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
+{
+	struct imx307 *imx307 = to_imx307(sd);
+	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct imx307_open_power *ref, *found = NULL;
+
+	mutex_lock(&imx307->mutex);
+	list_for_each_entry(ref, &imx307->open_power_fhs, list) {
+		if (ref->fh == fh) {
+			list_del(&ref->list);
+			found = ref;
+			break;
+		}
+	}
+	mutex_unlock(&imx307->mutex);
+
+	if (found) {
+		kfree(found);
+		pm_runtime_mark_last_busy(&client->dev);
+		pm_runtime_put_autosuspend(&client->dev);
+	}
+
+	return 0;
+}
+
 static const struct v4l2_subdev_internal_ops imx307_internal_ops = {
 	.open = imx307_open,
+	.close = imx307_close,
 };
 
 /* Initialize control handlers */
@@ -1351,11 +3493,12 @@ static int imx307_init_controls(struct imx307 *imx307)
 	struct v4l2_ctrl_handler *ctrl_hdlr;
 	unsigned int height = imx307->mode->height;
 	struct v4l2_fwnode_device_properties props;
+	struct v4l2_ctrl_config exposure_us;
 	int exposure_max, exposure_def, hblank;
 	int i, ret;
 
 	ctrl_hdlr = &imx307->ctrl_handler;
-	ret = v4l2_ctrl_handler_init(ctrl_hdlr, 11);
+	ret = v4l2_ctrl_handler_init(ctrl_hdlr, 20);
 	if (ret)
 		return ret;
 
@@ -1389,13 +3532,66 @@ static int imx307_init_controls(struct imx307 *imx307)
 					     imx307_EXPOSURE_STEP,
 					     exposure_def);
 
-	v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops, V4L2_CID_ANALOGUE_GAIN,
-			  imx307_ANA_GAIN_MIN, imx307_ANA_GAIN_MAX,
-			  imx307_ANA_GAIN_STEP, imx307_ANA_GAIN_DEFAULT);
+	imx307->auto_frame_length = v4l2_ctrl_new_custom(ctrl_hdlr,
+				&imx307_auto_frame_length_ctrl, NULL);
+
+	/* Exposure time controls, kept in sync with V4L2_CID_EXPOSURE */
+	imx307->exposure_abs = v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops,
+		V4L2_CID_EXPOSURE_ABSOLUTE,
+		max(imx307_lines_to_time(imx307, imx307_EXPOSURE_MIN,
+					 imx307_EXPOSURE_ABS_UNIT_NS), 1),
+		imx307_lines_to_time(imx307, exposure_max,
+				     imx307_EXPOSURE_ABS_UNIT_NS),
+		1,
+		imx307_lines_to_time(imx307, exposure_def,
+				     imx307_EXPOSURE_ABS_UNIT_NS));
+
+	exposure_us = imx307_exposure_us_ctrl;
+	exposure_us.min = imx307_lines_to_time(imx307, imx307_EXPOSURE_MIN,
+					       NSEC_PER_USEC);
+	exposure_us.max = imx307_lines_to_time(imx307, exposure_max,
+					       NSEC_PER_USEC);
+	exposure_us.def = imx307_lines_to_time(imx307, exposure_def,
+					       NSEC_PER_USEC);
+	imx307->exposure_us = v4l2_ctrl_new_custom(ctrl_hdlr, &exposure_us,
+						   NULL);
+
+	imx307->again = v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops,
+					  V4L2_CID_ANALOGUE_GAIN,
+					  imx307_ANA_GAIN_MIN,
+					  imx307_ANA_GAIN_MAX,
+					  imx307_ANA_GAIN_STEP,
+					  imx307_ANA_GAIN_DEFAULT);
+
+	imx307->dgain = v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops,
+					  V4L2_CID_DIGITAL_GAIN,
+					  imx307_DGTL_GAIN_MIN,
+					  imx307_DGTL_GAIN_MAX,
+					  imx307_DGTL_GAIN_STEP,
+					  imx307_DGTL_GAIN_DEFAULT);
+
+	/* Combined gain, kept in sync with the analogue and digital gains */
+	imx307->gain_db = v4l2_ctrl_new_custom(ctrl_hdlr, &imx307_gain_db_ctrl,
+					       NULL);
+
+	/* Per frame exposure, gain and frame length sequence */
+	v4l2_ctrl_new_custom(ctrl_hdlr, &imx307_bracket_ctrl, NULL);
 
-	v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops, V4L2_CID_DIGITAL_GAIN,
-			  imx307_DGTL_GAIN_MIN, imx307_DGTL_GAIN_MAX,
-			  imx307_DGTL_GAIN_STEP, imx307_DGTL_GAIN_DEFAULT);
+	/*
+	 * Leaving standby takes a startup time that is not documented for
+	 * this register map, so only XVS can tell when the frames of a
+	 * triggered capture start and end.
+	 */
+	if (imx307->xvs_irq > 0) {
+		imx307->trigger_mode =
+			v4l2_ctrl_new_custom(ctrl_hdlr,
+					     &imx307_trigger_mode_ctrl, NULL);
+		v4l2_ctrl_new_custom(ctrl_hdlr, &imx307_trigger_frames_ctrl,
+				     NULL);
+		v4l2_ctrl_new_custom(ctrl_hdlr, &imx307_trigger_ctrl, NULL);
+		v4l2_ctrl_new_custom(ctrl_hdlr, &imx307_trigger_latency_ctrl,
+				     NULL);
+	}
 
 	imx307->hflip = v4l2_ctrl_new_std(ctrl_hdlr, &imx307_ctrl_ops,
 					  V4L2_CID_HFLIP, 0, 1, 1, 0);
@@ -1460,7 +3656,7 @@ static void imx307_free_controls(struct imx307 *imx307)
 	mutex_destroy(&imx307->mutex);
 }
 
-static int imx307_check_hwcfg(struct device *dev)
+static int imx307_check_hwcfg(struct device *dev, struct imx307 *imx307)
 {
 	struct fwnode_handle *endpoint;
 	struct v4l2_fwnode_endpoint ep_cfg = {
@@ -1498,6 +3694,10 @@ static int imx307_check_hwcfg(struct device *dev)
 		goto error_out;
 	}
 
+	/* Reported to the receiver through .get_mbus_config */
+	imx307->num_data_lanes = ep_cfg.bus.mipi_csi2.num_data_lanes;
+	imx307->csi2_flags = ep_cfg.bus.mipi_csi2.flags;
+
 	ret = 0;
 
 error_out:
@@ -1511,6 +3711,7 @@ static int imx307_probe(struct i2c_client *client)
 {
 	struct device *dev = &client->dev;
 	struct imx307 *imx307;
+	const char *fw_name;
 	int ret;
 
 	imx307 = devm_kzalloc(&client->dev, sizeof(*imx307), GFP_KERNEL);
@@ -1520,7 +3721,7 @@ static int imx307_probe(struct i2c_client *client)
 	v4l2_i2c_subdev_init(&imx307->sd, client, &imx307_subdev_ops);
 
 	/* Check the hardware configuration in device tree */
-	if (imx307_check_hwcfg(dev))
+	if (imx307_check_hwcfg(dev, imx307))
 		return -EINVAL;
 
 	/* Get system clock (xclk) */
@@ -1547,41 +3748,100 @@ static int imx307_probe(struct i2c_client *client)
 	imx307->reset_gpio = devm_gpiod_get_optional(dev, "reset",
 						     GPIOD_OUT_HIGH);
 
+	/* Request optional XVS input, used for frame sync events */
+	imx307->xvs_gpio = devm_gpiod_get_optional(dev, "xvs", GPIOD_IN);
+	if (IS_ERR(imx307->xvs_gpio))
+		return PTR_ERR(imx307->xvs_gpio);
+
+	if (imx307->xvs_gpio) {
+		imx307->xvs_irq = gpiod_to_irq(imx307->xvs_gpio);
+		if (imx307->xvs_irq < 0)
+			return imx307->xvs_irq;
+
+		/* Only enabled while streaming */
+		irq_set_status_flags(imx307->xvs_irq, IRQ_NOAUTOEN);
+		ret = devm_request_irq(dev, imx307->xvs_irq, imx307_xvs_irq,
+				       IRQF_TRIGGER_FALLING, dev_name(dev),
+				       imx307);
+		if (ret) {
+			dev_err(dev, "failed to request XVS irq: %d\n", ret);
+			return ret;
+		}
+	}
+
+	/* Request optional trigger input, used in trigger mode with XVS */
+	imx307->trigger_gpio = devm_gpiod_get_optional(dev, "trigger",
+						       GPIOD_IN);
+	if (IS_ERR(imx307->trigger_gpio))
+		return PTR_ERR(imx307->trigger_gpio);
+
+	if (imx307->trigger_gpio && imx307->xvs_irq <= 0) {
+		dev_warn(dev, "trigger input needs XVS, ignoring it\n");
+	} else if (imx307->trigger_gpio) {
+		imx307->trigger_irq = gpiod_to_irq(imx307->trigger_gpio);
+		if (imx307->trigger_irq < 0)
+			return imx307->trigger_irq;
+
+		/* Triggers are ignored unless armed */
+		ret = devm_request_irq(dev, imx307->trigger_irq,
+				       imx307_trigger_irq, IRQF_TRIGGER_RISING,
+				       dev_name(dev), imx307);
+		if (ret) {
+			dev_err(dev, "failed to request trigger irq: %d\n",
+				ret);
+			return ret;
+		}
+	}
+
 	/*
 	 * The sensor must be powered for imx307_identify_module()
-	 * to be able to read the CHIP_ID register
+	 * to be able to read the CHIP_ID register. Release XCLR now and
+	 * set up the software state while the sensor comes out of reset.
 	 */
-	ret = imx307_power_on(dev);
+	ret = __imx307_power_on(dev);
 	if (ret)
 		return ret;
 
-	ret = imx307_identify_module(imx307);
-	if (ret)
-		goto error_power_off;
+	imx307->modes = supported_modes;
+	imx307->num_modes = ARRAY_SIZE(supported_modes);
+	memcpy(imx307->framefmt_bursts, imx307_framefmt_bursts,
+	       sizeof(imx307_framefmt_bursts));
+
+	/* Optionally replace the built-in tables with firmware ones */
+	if (!device_property_read_string(dev, "firmware-name", &fw_name)) {
+		ret = imx307_load_firmware(imx307, fw_name);
+		if (ret)
+			dev_warn(dev, "using built-in mode tables (%d)\n", ret);
+	}
 
 	/* Set default mode to max resolution */
-	imx307->mode = &supported_modes[0];
+	imx307->mode = &imx307->modes[0];
 
-	/* sensor doesn't enter LP-11 state upon power up until and unless
-	 * streaming is started, so upon power up switch the modes to:
-	 * streaming -> standby
-	 */
-	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
-			       imx307_REG_VALUE_08BIT, imx307_MODE_STREAMING);
-	if (ret < 0)
-		goto error_power_off;
-	usleep_range(100, 110);
+	INIT_DELAYED_WORK(&imx307->watchdog_work, imx307_watchdog_work);
+	INIT_LIST_HEAD(&imx307->open_power_fhs);
 
-	/* put sensor back to standby mode */
-	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
-			       imx307_REG_VALUE_08BIT, imx307_MODE_STANDBY);
-	if (ret < 0)
+	mutex_init(&imx307->sched_lock);
+	kthread_init_work(&imx307->sched_work, imx307_sched_work);
+	hrtimer_init(&imx307->vsync_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	imx307->vsync_timer.function = imx307_vsync_timer;
+
+	kthread_init_work(&imx307->trigger_work, imx307_trigger_work);
+	kthread_init_work(&imx307->trigger_stop_work,
+			  imx307_trigger_stop_work);
+
+	imx307->sched_worker = kthread_create_worker(0, "imx307-%s",
+						     dev_name(dev));
+	if (IS_ERR(imx307->sched_worker)) {
+		ret = PTR_ERR(imx307->sched_worker);
 		goto error_power_off;
-	usleep_range(100, 110);
+	}
+
+	/* Writes must go out early in the frame to make the latch point */
+	sched_set_fifo(imx307->sched_worker->task);
 
 	ret = imx307_init_controls(imx307);
 	if (ret)
-		goto error_power_off;
+		goto error_destroy_worker;
 
 	/* Initialize subdev */
 	imx307->sd.internal_ops = &imx307_internal_ops;
@@ -1602,6 +3862,29 @@ static int imx307_probe(struct i2c_client *client)
 		goto error_handler_free;
 	}
 
+	imx307_wait_xclr(imx307);
+
+	ret = imx307_identify_module(imx307);
+	if (ret)
+		goto error_media_entity;
+
+	/* sensor doesn't enter LP-11 state upon power up until and unless
+	 * streaming is started, so upon power up switch the modes to:
+	 * streaming -> standby
+	 */
+	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+			       imx307_REG_VALUE_08BIT, imx307_MODE_STREAMING);
+	if (ret < 0)
+		goto error_media_entity;
+	usleep_range(100, 110);
+
+	/* put sensor back to standby mode */
+	ret = imx307_write_reg(imx307, imx307_REG_MODE_SELECT,
+			       imx307_REG_VALUE_08BIT, imx307_MODE_STANDBY);
+	if (ret < 0)
+		goto error_media_entity;
+	usleep_range(100, 110);
+
 	ret = v4l2_async_register_subdev_sensor_common(&imx307->sd);
 	if (ret < 0) {
 		dev_err(dev, "failed to register sensor sub-device: %d\n", ret);
@@ -1611,6 +3894,8 @@ static int imx307_probe(struct i2c_client *client)
 	/* Enable runtime PM and turn off the device */
 	pm_runtime_set_active(dev);
 	pm_runtime_enable(dev);
+	pm_runtime_set_autosuspend_delay(dev, imx307_AUTOSUSPEND_DELAY_MS);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_idle(dev);
 
 	return 0;
@@ -1621,6 +3906,10 @@ error_media_entity:
 error_handler_free:
 	imx307_free_controls(imx307);
 
+error_destroy_worker:
+	kthread_destroy_worker(imx307->sched_worker);
+	mutex_destroy(&imx307->sched_lock);
+
 error_power_off:
 	imx307_power_off(dev);
 
@@ -1633,10 +3922,25 @@ static int imx307_remove(struct i2c_client *client)
 	struct imx307 *imx307 = to_imx307(sd);
 
 	v4l2_async_unregister_subdev(sd);
+
+	/*
+	 * The subdev may have been left streaming. Stop everything that
+	 * queues work on the scheduler worker before destroying it. The
+	 * interrupts are only freed by devres after this returns.
+	 */
+	if (imx307->xvs_irq > 0)
+		disable_irq(imx307->xvs_irq);
+	if (imx307->trigger_irq > 0)
+		disable_irq(imx307->trigger_irq);
+	hrtimer_cancel(&imx307->vsync_timer);
+	cancel_delayed_work_sync(&imx307->watchdog_work);
+	kthread_destroy_worker(imx307->sched_worker);
+	mutex_destroy(&imx307->sched_lock);
 	media_entity_cleanup(&sd->entity);
 	imx307_free_controls(imx307);
 
 	pm_runtime_disable(&client->dev);
+	pm_runtime_dont_use_autosuspend(&client->dev);
 	if (!pm_runtime_status_suspended(&client->dev))
 		imx307_power_off(&client->dev);
 	pm_runtime_set_suspended(&client->dev);
@@ -1650,6 +3954,12 @@ static const struct of_device_id imx307_dt_ids[] = {
 };
 MODULE_DEVICE_TABLE(of, imx307_dt_ids);
 
+static const struct i2c_device_id imx307_id[] = {
+	{ "imx307", 0 },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(i2c, imx307_id);
+
 static const struct dev_pm_ops imx307_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(imx307_suspend, imx307_resume)
 	SET_RUNTIME_PM_OPS(imx307_power_off, imx307_power_on, NULL)
@@ -1660,7 +3970,10 @@ static struct i2c_driver imx307_i2c_driver = {
 		.name = "imx307",
 		.of_match_table	= imx307_dt_ids,
 		.pm = &imx307_pm_ops,
+		.dev_groups = imx307_groups,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
+	.id_table = imx307_id,
 	.probe_new = imx307_probe,
 	.remove = imx307_remove,
 };